@@ -0,0 +1,37 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec3 color;
+layout (location = 3) in vec2 uv;
+
+// Per-instance attributes: rows of the model matrix and color
+layout (location = 4) in vec4 model_row0;
+layout (location = 5) in vec4 model_row1;
+layout (location = 6) in vec4 model_row2;
+layout (location = 7) in vec4 model_row3;
+layout (location = 8) in vec3 instance_color;
+
+out struct fragment_data
+{
+    vec3 position;
+    vec3 normal;
+    vec3 color;
+    vec2 uv;
+	vec3 eye;
+} fragment;
+
+// Per-frame state of the scene: block scene_data of shader/scene_data.glsl, inserted after the #version line when the file is read
+
+void main()
+{
+	mat4 model = transpose(mat4(model_row0, model_row1, model_row2, model_row3));
+
+	fragment.position = vec3(model * vec4(position,1.0));
+	fragment.normal   = vec3(model * vec4(normal  ,0.0));
+	fragment.color = color * instance_color;
+	fragment.uv = uv;
+	fragment.eye = vec3(inverse(view)*vec4(0,0,0,1.0));
+
+	gl_Position = projection * view * model * vec4(position, 1.0);
+}
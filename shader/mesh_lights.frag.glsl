@@ -14,7 +14,7 @@ layout(location=0) out vec4 FragColor;
 
 uniform sampler2D image_texture;
 
-uniform vec3 light = vec3(1.0, 1.0, 1.0);
+// Per-frame state of the scene: block scene_data of shader/scene_data.glsl, inserted after the #version line when the file is read
 
 uniform vec3 color = vec3(1.0, 1.0, 1.0); // Unifor color of the object
 uniform float alpha = 1.0f; // alpha coefficient
@@ -25,10 +25,11 @@ uniform float specular_exp = 64.0; // Specular exponent
 uniform bool use_texture = true;
 uniform bool texture_inverse_y = false;
 
-uniform vec3 spotlight_color[5];
-uniform vec3 spotlight_position[5];
-uniform float spotlight_falloff;
-uniform float fog_falloff;
+// Clustered lights (see src/clustered_lighting.hpp)
+uniform usamplerBuffer cluster_grid;    // offset and number of lights of each cluster in cluster_lights
+uniform usamplerBuffer cluster_lights;  // indices of the lights of the clusters
+uniform samplerBuffer light_data;       // 2 texels per light: (position, radius) and (color, 0)
+
 
 void main()
 {
@@ -48,10 +49,22 @@ void main()
 	vec3 color_object  = fragment.color * color * color_image_texture.rgb;
 	vec3 color_shading = Ka * color_object;
 
-	for(int k_light=0; k_light<5; k_light++)
+	// Cluster of the fragment: screen tile and depth slice
+	ivec2 tile = ivec2((gl_FragCoord.xy-viewport.zw)/viewport.xy*vec2(cluster_size.xy));
+	tile = clamp(tile, ivec2(0), cluster_size.xy-1);
+	float view_depth = max(-(view*vec4(fragment.position,1.0)).z, cluster_depth.z);
+	int slice = clamp(int(log(view_depth)*cluster_depth.x+cluster_depth.y), 0, cluster_size.z-1);
+	uvec2 cluster = texelFetch(cluster_grid, tile.x+cluster_size.x*(tile.y+cluster_size.y*slice)).xy;
+
+	for(uint k=0u; k<cluster.y; k++)
 	{
-		vec3 v = spotlight_position[k_light]-fragment.position;
+		int k_light = int(texelFetch(cluster_lights, int(cluster.x+k)).x);
+		vec4 light_position = texelFetch(light_data, 2*k_light);
+		vec3 v = light_position.xyz-fragment.position;
 		float dist = length(v);
+		if(dist>light_position.w) {
+			continue;
+		}
 		vec3 L = normalize(v);
 		float diffuse = max(dot(N,L),0.0);
 		float specular = 0.0;
@@ -62,7 +75,7 @@ void main()
 		}
 		
 		// spotlight color
-		color_shading += (Kd*diffuse*color_object + Ks * specular)*spotlight_color[k_light]*exp(-spotlight_falloff*dist*dist);
+		color_shading += (Kd*diffuse*color_object + Ks * specular)*texelFetch(light_data, 2*k_light+1).rgb*exp(-spotlight_falloff*dist*dist);
 	}
 
     //fog effect
@@ -15,8 +15,7 @@ out struct fragment_data
 } fragment;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Per-frame state of the scene: block scene_data of shader/scene_data.glsl, inserted after the #version line when the file is read
 
 void main()
 {
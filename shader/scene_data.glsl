@@ -0,0 +1,14 @@
+// Per-frame state of the scene, shared by every program (see src/scene_uniforms.hpp)
+layout(std140, row_major) uniform scene_data
+{
+	mat4 projection;
+	mat4 view;
+	vec4 light;
+	float time;
+	float spotlight_falloff;
+	float fog_falloff;
+	int spotlight_count;
+	vec4 viewport;        // width, height and corner of the viewport in pixels
+	ivec4 cluster_size;   // number of light clusters along x, y and the depth
+	vec4 cluster_depth;   // slice = log(depth)*x + y, near and far planes
+};
@@ -14,7 +14,7 @@ layout(location=0) out vec4 FragColor;
 
 uniform sampler2D image_texture;
 
-uniform vec3 light = vec3(1.0, 1.0, 1.0);
+// Per-frame state of the scene: block scene_data of shader/scene_data.glsl, inserted after the #version line when the file is read
 
 uniform vec3 color = vec3(1.0, 1.0, 1.0); // Unifor color of the object
 uniform float alpha = 1.0f; // alpha coefficient
@@ -32,7 +32,7 @@ void main()
 	if (gl_FrontFacing == false) {
 		N = -N;
 	}
-	vec3 L = normalize(light-fragment.position);
+	vec3 L = normalize(light.xyz-fragment.position);
 
 	float diffuse = max(dot(N,L),0.0);
 	float specular = 0.0;
@@ -0,0 +1,118 @@
+#include "asset_manager.hpp"
+#include "mesh_binary.hpp"
+
+#include <thread>
+
+using namespace vcl;
+
+void asset_manager::initialize(unsigned int N_thread)
+{
+    pool.reset(new thread_pool(N_thread));
+}
+
+GLuint asset_manager::create_texture(std::string const& key, GLint wrap_s, GLint wrap_t)
+{
+    // White texture until the image is loaded
+    GLuint id = 0;
+    glGenTextures(1, &id);
+    texture_image white;
+    white.levels.push_back({1, 1, {255,255,255,255}});
+    opengl_texture_update(id, white, wrap_s, wrap_t);
+    textures[key] = id;
+    ++textures_pending;
+    return id;
+}
+
+GLuint asset_manager::texture(std::string const& path, GLint wrap_s, GLint wrap_t)
+{
+    auto const it = textures.find(path);
+    if(it!=textures.end())
+        return it->second;
+
+    GLuint const id = create_texture(path, wrap_s, wrap_t);
+    pool->submit([this, path, id, wrap_s, wrap_t]() {
+        decoded_image result = {id, texture_image(), wrap_s, wrap_t};
+        try {
+            result.image = load_texture_image(path);
+        }
+        catch(std::exception const& e) {
+            std::cerr<<"Cannot load texture "<<path<<": "<<e.what()<<std::endl; // the texture stays white
+        }
+        std::lock_guard<std::mutex> lock(decoded_mutex);
+        decoded.push_back(std::move(result));
+    });
+    return id;
+}
+
+GLuint asset_manager::atlas_texture(std::string const& name, texture_atlas const& atlas)
+{
+    std::string const key = "atlas:" + name;
+    auto const it = textures.find(key);
+    if(it!=textures.end())
+        return it->second;
+
+    GLuint const id = create_texture(key, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+    pool->submit([this, name, id, atlas]() {
+        decoded_image result = {id, texture_image(), GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE};
+        try {
+            result.image = atlas.compose();
+        }
+        catch(std::exception const& e) {
+            std::cerr<<"Cannot build the atlas "<<name<<": "<<e.what()<<std::endl;
+        }
+        std::lock_guard<std::mutex> lock(decoded_mutex);
+        decoded.push_back(std::move(result));
+    });
+    return id;
+}
+
+void asset_manager::request_mesh(std::string const& path)
+{
+    if(meshes.count(path))
+        return;
+
+    std::shared_ptr<std::promise<vcl::mesh>> const result = std::make_shared<std::promise<vcl::mesh>>();
+    meshes[path] = result->get_future().share();
+    pool->submit([path, result]() {
+        try {
+            result->set_value(load_mesh(path));
+        }
+        catch(...) {
+            result->set_exception(std::current_exception()); // raised again by mesh() on the main thread
+        }
+    });
+}
+
+vcl::mesh const& asset_manager::mesh(std::string const& path)
+{
+    request_mesh(path);
+    return meshes.at(path).get();
+}
+
+size_t asset_manager::poll()
+{
+    std::vector<decoded_image> received;
+    {
+        std::lock_guard<std::mutex> lock(decoded_mutex);
+        received.swap(decoded);
+    }
+    for(decoded_image const& result : received) {
+        if(!result.image.levels.empty())
+            opengl_texture_update(result.texture, result.image, result.wrap_s, result.wrap_t);
+    }
+    textures_pending -= received.size();
+    return received.size();
+}
+
+void asset_manager::wait()
+{
+    while(textures_pending>0) {
+        if(poll()==0)
+            std::this_thread::yield();
+    }
+}
+
+size_t asset_manager::pending_textures() const
+{
+    return textures_pending;
+}
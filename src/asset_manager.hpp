@@ -0,0 +1,53 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include "thread_pool.hpp"
+#include "texture_pipeline.hpp"
+
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** Meshes and textures of the assets, loaded once per path on a pool of worker threads
+*  - texture() returns at once a texture object, white until its image and mip chain are loaded (see texture_pipeline.hpp)
+*     and sent to the GPU by poll() (main thread)
+*  - request_mesh() starts the loading of a mesh, mesh() waits for it (blocking: the scene is built from the meshes at startup)
+*  - Requesting the same path again returns the same texture or mesh (the wrap modes of the first request are kept) */
+struct asset_manager
+{
+    void initialize(unsigned int N_thread = 0);
+
+    GLuint texture(std::string const& path, GLint wrap_s = GL_CLAMP_TO_EDGE, GLint wrap_t = GL_CLAMP_TO_EDGE);
+    // Texture of an atlas (layout already computed), composed on the worker threads. name identifies the atlas
+    GLuint atlas_texture(std::string const& name, texture_atlas const& atlas);
+    void request_mesh(std::string const& path);
+    vcl::mesh const& mesh(std::string const& path);
+
+    // Send the decoded images to the GPU (main thread only), return the number of textures updated
+    size_t poll();
+    // Wait until every requested texture is decoded and sent to the GPU
+    void wait();
+    size_t pending_textures() const;
+
+private:
+    struct decoded_image
+    {
+        GLuint texture;
+        texture_image image;
+        GLint wrap_s, wrap_t;
+    };
+
+    GLuint create_texture(std::string const& key, GLint wrap_s, GLint wrap_t);
+
+    std::map<std::string, GLuint> textures;
+    std::map<std::string, std::shared_future<vcl::mesh>> meshes;
+    size_t textures_pending = 0;
+
+    std::mutex decoded_mutex;
+    std::vector<decoded_image> decoded;
+
+    std::unique_ptr<thread_pool> pool; // last member: the workers are stopped before the decoded images are destroyed
+};
@@ -0,0 +1,361 @@
+#include "benchmark.hpp"
+#include "clustered_lighting.hpp"
+#include "culling.hpp"
+#include "flock.hpp"
+#include "heightfield.hpp"
+#include "job_system.hpp"
+#include "mesh_binary.hpp"
+#include "noise_simd.hpp"
+#include "precipitation.hpp"
+#include "terrain.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace vcl;
+
+benchmark_parameters parse_benchmark_arguments(int argc, char* argv[])
+{
+    benchmark_parameters parameters;
+    for(int k=1; k<argc; ++k) {
+        std::string const arg = argv[k];
+        if(arg=="--benchmark" && k+1<argc)
+            parameters.frames = std::max(0, std::atoi(argv[++k]));
+        else if(arg=="--benchmark-culling" && k+1<argc)
+            parameters.culling_objects = std::max(0, std::atoi(argv[++k]));
+        else if(arg=="--benchmark-noise" && k+1<argc)
+            parameters.noise_resolution = std::max(0, std::atoi(argv[++k]));
+        else if(arg=="--benchmark-terrain" && k+1<argc)
+            parameters.terrain_resolution = std::max(0, std::atoi(argv[++k]));
+        else if(arg=="--benchmark-mesh-loading")
+            parameters.mesh_loading = true;
+        else if(arg=="--benchmark-lights" && k+1<argc)
+            parameters.lights = std::max(0, std::atoi(argv[++k]));
+        else if(arg=="--benchmark-snow" && k+1<argc)
+            parameters.snowflakes = std::max(0, std::atoi(argv[++k]));
+        else if(arg=="--benchmark-jobs" && k+1<argc)
+            parameters.job_frames = std::max(0, std::atoi(argv[++k]));
+    }
+    return parameters;
+}
+
+void benchmark_culling(size_t N, std::ostream& out)
+{
+    using clock = std::chrono::steady_clock;
+
+    // Objects scattered in a flat box around the origin, with a constant density
+    std::mt19937 generator(42);
+    float const extent = 2*std::sqrt(float(N));
+    std::uniform_real_distribution<float> coordinate(-extent, extent);
+    std::uniform_real_distribution<float> height(0, 10);
+    std::uniform_real_distribution<float> radius(0.1f, 1.0f);
+    std::vector<bounding_sphere> spheres(N);
+    for(bounding_sphere& sphere : spheres)
+        sphere = {vec3(coordinate(generator), coordinate(generator), height(generator)), radius(generator)};
+
+    clock::time_point const build_start = clock::now();
+    bvh hierarchy;
+    hierarchy.build(spheres);
+    double const build_time = std::chrono::duration<double>(clock::now()-build_start).count();
+
+    // The camera turns around the origin, looking outward, during the frames
+    mat4 const projection = projection_perspective(50*3.14159f/180, 16/9.0f, 0.1f, 2*extent);
+    camera_around_center camera;
+    int const frames = 100;
+    std::vector<uint32_t> visible;
+    size_t total_visible = 0;
+    double cull_time = 0;
+    for(int k=0; k<frames; ++k) {
+        float const angle = 2*3.14159f*k/frames;
+        camera.distance_to_center = 1.0f;
+        camera.look_at({0,0,5}, {std::cos(angle),std::sin(angle),5}, {0,0,1});
+
+        clock::time_point const cull_start = clock::now();
+        hierarchy.cull(frustum(projection*camera.matrix_view()), visible);
+        cull_time += std::chrono::duration<double>(clock::now()-cull_start).count();
+        total_visible += visible.size();
+    }
+
+    double const mean_visible = total_visible/double(frames);
+    out<<"Objects: "<<N<<std::endl;
+    out<<"BVH build time: "<<1000*build_time<<" ms"<<std::endl;
+    out<<"Visible objects per frame: "<<mean_visible<<std::endl;
+    out<<"Culled objects per frame: "<<N-mean_visible<<std::endl;
+    out<<"CPU culling time per frame: "<<1000*cull_time/frames<<" ms"<<std::endl;
+}
+
+void benchmark_noise(size_t N, std::ostream& out)
+{
+    using clock = std::chrono::steady_clock;
+    if(N<2)
+        return;
+    perlin_noise_parameters const noise = parameters;
+
+    std::vector<float> v(N), heightmap(N*N);
+    for(size_t k=0; k<N; ++k)
+        v[k] = k/(N-1.0f);
+
+    char const* kernel = noise_perlin_kernel(); // the kernel is selected before the timing
+    clock::time_point const batch_start = clock::now();
+    for(size_t ku=0; ku<N; ++ku)
+        noise_perlin_row(ku/(N-1.0f), v.data(), N, &heightmap[N*ku], noise.octave, noise.persistency, noise.frequency_gain);
+    double const batch_time = std::chrono::duration<double>(clock::now()-batch_start).count();
+
+    // One row every 16 for the reference: its time is extrapolated to the whole heightmap
+    size_t const step = 16;
+    size_t rows = 0;
+    float error = 0;
+    clock::time_point const reference_start = clock::now();
+    for(size_t ku=0; ku<N; ku+=step, ++rows)
+        for(size_t kv=0; kv<N; ++kv)
+            error = std::max(error, std::abs(heightmap[kv+N*ku]-noise_perlin({ku/(N-1.0f), v[kv]}, noise.octave, noise.persistency, noise.frequency_gain)));
+    double const reference_time = std::chrono::duration<double>(clock::now()-reference_start).count() * N/double(rows);
+
+    out<<"Heightmap: "<<N<<" x "<<N<<", "<<noise.octave<<" octaves"<<std::endl;
+    out<<"Kernel: "<<kernel<<std::endl;
+    out<<"Batch noise time: "<<1000*batch_time<<" ms"<<std::endl;
+    out<<"vcl::noise_perlin time (estimated): "<<1000*reference_time<<" ms"<<std::endl;
+    out<<"Maximal difference: "<<error<<std::endl;
+}
+
+void benchmark_terrain(unsigned int N, std::ostream& out)
+{
+    using clock = std::chrono::steady_clock;
+    if(N<2)
+        return;
+
+    clock::time_point const start = clock::now();
+    mesh const terrain = create_terrain(N);
+    double const time = std::chrono::duration<double>(clock::now()-start).count();
+
+    out<<"Terrain: "<<N<<" x "<<N<<" vertices, "<<terrain.connectivity.size()<<" triangles"<<std::endl;
+    out<<"Threads: "<<job_system::global().size()<<std::endl;
+    out<<"Build time: "<<1000*time<<" ms"<<std::endl;
+}
+
+void benchmark_mesh_loading(std::ostream& out)
+{
+    using clock = std::chrono::steady_clock;
+    std::vector<std::string> const assets = {"assets/statue.obj", "assets/trunk.obj", "assets/branches.obj", "assets/foliage.obj"};
+
+    double total_obj = 0, total_binary = 0;
+    for(std::string const& obj_path : assets) {
+        clock::time_point const obj_start = clock::now();
+        mesh const obj = mesh_load_file_obj(obj_path);
+        double const obj_time = std::chrono::duration<double>(clock::now()-obj_start).count();
+        total_obj += obj_time;
+        out<<obj_path<<": OBJ "<<1000*obj_time<<" ms ("<<obj.position.size()<<" vertices)";
+
+        mesh binary;
+        clock::time_point const binary_start = clock::now();
+        bool const loaded = load_mesh_binary(binary_mesh_path(obj_path), read_mesh_source(obj_path), binary);
+        double const binary_time = std::chrono::duration<double>(clock::now()-binary_start).count();
+        if(loaded) {
+            total_binary += binary_time;
+            out<<", binary "<<1000*binary_time<<" ms ("<<binary.position.size()<<" vertices)"<<std::endl;
+        }
+        else
+            out<<", no up-to-date binary file (see --convert-obj)"<<std::endl;
+    }
+    out<<"Total: OBJ "<<1000*total_obj<<" ms, binary "<<1000*total_binary<<" ms"<<std::endl;
+}
+
+void frame_statistics::start_frame()
+{
+    draw_calls = 0;
+    frame_start = std::chrono::steady_clock::now();
+}
+
+void frame_statistics::end_frame()
+{
+    cpu_time = std::chrono::duration<double>(std::chrono::steady_clock::now()-frame_start).count();
+    total_cpu_time += cpu_time;
+    total_draw_calls += draw_calls;
+    last_draw_calls = draw_calls;
+    ++frames;
+}
+
+void frame_statistics::print(std::ostream& out) const
+{
+    if(frames==0)
+        return;
+    out<<"Frames: "<<frames<<std::endl;
+    out<<"Draw calls per frame: "<<total_draw_calls/double(frames)<<std::endl;
+    out<<"CPU time per frame: "<<1000*total_cpu_time/frames<<" ms"<<std::endl;
+}
+
+void benchmark_lights(size_t N, std::ostream& out)
+{
+    using clock = std::chrono::steady_clock;
+
+    // Lamps every 2 units along parallel paths, with the density of the street lamps of the scene
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> jitter(-0.2f, 0.2f);
+    size_t const paths = std::max<size_t>(1, size_t(std::sqrt(N/4.0)));
+    size_t const per_path = (N+paths-1)/paths;
+    light_registry lights;
+    lights.set_falloff(0.5f);
+    for(size_t k=0; k<N; ++k) {
+        float const x = 2.0f*(k%per_path) - per_path;
+        float const y = 8.0f*(k/per_path) - 4.0f*paths;
+        lights.add_static({x+jitter(generator), y+jitter(generator), 1.1f}, {0.75f, 0.75f, 0.8f});
+    }
+    float const radius = spotlight_radius(lights.falloff);
+
+    mat4 const projection = projection_perspective(50*3.14159f/180, 16/9.0f, 0.1f, 200.0f);
+    camera_around_center camera;
+    light_clusters clusters;
+    int const frames = 100;
+    double bin_time = 0;
+    size_t total_entries = 0, total_visible = 0, max_lights = 0, missing = 0;
+    std::uniform_real_distribution<float> unit(-1, 1);
+    std::uniform_real_distribution<float> depth(0.1f, 100.0f);
+    for(int k=0; k<frames; ++k) {
+        float const angle = 2*3.14159f*k/frames;
+        camera.distance_to_center = 1.0f;
+        camera.look_at({0,0,3}, {std::cos(angle),std::sin(angle),2.5f}, {0,0,1});
+        mat4 const view = camera.matrix_view();
+
+        clock::time_point const bin_start = clock::now();
+        clusters.bin(projection, view, lights);
+        bin_time += std::chrono::duration<double>(clock::now()-bin_start).count();
+        total_entries += clusters.indices.size();
+        total_visible += clusters.visible_lights;
+        max_lights = std::max(max_lights, clusters.max_cluster_lights);
+
+        // Random points of the frustum: every light within its radius must be in the list of the cluster
+        for(int s=0; s<100; ++s) {
+            float const d = depth(generator);
+            vec3 const p_view = {unit(generator)*d/projection(0,0), unit(generator)*d/projection(1,1), d};
+            size_t const c = clusters.cluster(p_view);
+            uint32_t const* list = &clusters.indices[clusters.grid[2*c]];
+            uint32_t const* list_end = list + clusters.grid[2*c+1];
+            for(size_t i=0; i<N; ++i) {
+                vec4 const q = view*vec4(lights.position[i], 1.0f);
+                if(norm(vec3(q.x,q.y,-q.z)-p_view)<=radius && std::find(list, list_end, uint32_t(i))==list_end)
+                    missing++;
+            }
+        }
+    }
+
+    out<<"Spotlights: "<<N<<" (radius "<<radius<<")"<<std::endl;
+    out<<"Lights in the view frustum per frame: "<<total_visible/double(frames)<<std::endl;
+    out<<"Clusters: "<<clusters.tiles_x<<" x "<<clusters.tiles_y<<" x "<<clusters.slices<<std::endl;
+    out<<"Threads: "<<job_system::global().size()<<std::endl;
+    out<<"CPU binning time per frame: "<<1000*bin_time/frames<<" ms"<<std::endl;
+    out<<"Mean lights per cluster: "<<total_entries/double(frames*clusters.size())<<std::endl;
+    out<<"Maximal lights per cluster: "<<max_lights<<std::endl;
+    out<<"Lights missing from a cluster: "<<missing<<std::endl;
+}
+
+void benchmark_snow(size_t N, std::ostream& out)
+{
+    using clock = std::chrono::steady_clock;
+
+    heightfield field;
+    field.build(parameters);
+
+    // The flakes fill the whole height of the emitter: some of them land on every step
+    precipitation_parameters snow;
+    snow.capacity = N;
+    snow.thickness = snow.height;
+    snow.rate = 0;
+    precipitation snowfall;
+    snowfall.initialize(snow);
+    snowfall.emit(N);
+
+    int const steps = int(std::lround(2.0/snow.step)); // 240: the quotient in float is slightly below
+    clock::time_point const start = clock::now();
+    for(int k=0; k<steps; ++k)
+        snowfall.step(field);
+    double const time = std::chrono::duration<double>(clock::now()-start).count();
+
+    out<<"Snowflakes: "<<N<<", "<<steps<<" steps of "<<1000*snow.step<<" ms"<<std::endl;
+    out<<"Threads: "<<job_system::global().size()<<std::endl;
+    out<<"Time per step: "<<1000*time/steps<<" ms"<<std::endl;
+    out<<"Landed flakes: "<<snowfall.landed<<", remaining: "<<snowfall.flakes.size()<<std::endl;
+    out<<"Checksum: "<<std::hex<<snowfall.checksum()<<std::dec<<std::endl;
+}
+
+void benchmark_jobs(size_t frames, std::ostream& out)
+{
+    using clock = std::chrono::steady_clock;
+
+    heightfield field;
+    field.build(parameters);
+
+    // Systems of the scene, scaled up so that the frame is long enough to be measured
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> coordinate(-200, 200);
+    std::uniform_real_distribution<float> height(0, 10);
+    std::uniform_real_distribution<float> radius(0.1f, 1.0f);
+    std::vector<bounding_sphere> spheres(100000);
+    for(bounding_sphere& sphere : spheres)
+        sphere = {vec3(coordinate(generator), coordinate(generator), height(generator)), radius(generator)};
+    bvh hierarchy;
+    hierarchy.build(spheres);
+
+    light_registry lights;
+    for(size_t k=0; k<2000; ++k)
+        lights.add_static({coordinate(generator)/4, coordinate(generator)/4, 1.1f}, {0.75f, 0.75f, 0.8f});
+
+    flock flock_start;
+    flock_start.initialize(3000, {0,0,8}, 4.0f);
+
+    precipitation_parameters snow;
+    snow.capacity = 100000;
+    snow.thickness = snow.height;
+    snow.rate = 0;
+
+    mat4 const projection = projection_perspective(50*3.14159f/180, 16/9.0f, 0.1f, 200.0f);
+    unsigned int const hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> thread_counts;
+    for(unsigned int n=1; n<hardware; n*=2)
+        thread_counts.push_back(n);
+    thread_counts.push_back(hardware);
+
+    out<<"Frames: "<<frames<<" - snowflakes: "<<snow.capacity<<" (2 steps per frame), birds: "<<flock_start.size()
+       <<", spotlights: "<<lights.size()<<", culled objects: "<<spheres.size()<<", terrain chunk: 128 x 128"<<std::endl;
+    double time_one_thread = 0;
+    for(unsigned int N_thread : thread_counts)
+    {
+        job_system jobs(N_thread);
+        job_system::set_global(&jobs); // parallel_for inside the systems uses the same threads
+
+        precipitation snowfall;
+        snowfall.initialize(snow);
+        snowfall.emit(snow.capacity);
+        flock birds = flock_start;
+        light_clusters clusters;
+        heightfield chunk;
+        camera_around_center camera;
+        std::vector<uint32_t> visible;
+
+        clock::time_point const start = clock::now();
+        for(size_t k=0; k<frames; ++k) {
+            float const angle = 2*3.14159f*k/frames;
+            camera.distance_to_center = 1.0f;
+            camera.look_at({0,0,3}, {std::cos(angle),std::sin(angle),2.5f}, {0,0,1});
+            mat4 const view = camera.matrix_view();
+
+            job_counter frame_jobs;
+            jobs.submit(frame_jobs, [&](){ snowfall.step(field); snowfall.step(field); });
+            jobs.submit(frame_jobs, [&](){ birds.update(1/60.0f, {0,0,8}, field); });
+            jobs.submit(frame_jobs, [&](){ clusters.bin(projection, view, lights); });
+            jobs.submit(frame_jobs, [&](){ hierarchy.cull(frustum(projection*view), visible); });
+            jobs.submit(frame_jobs, [&](){ chunk.build(parameters, 128); });
+            jobs.wait(frame_jobs);
+        }
+        double const time = std::chrono::duration<double>(clock::now()-start).count()/std::max<size_t>(frames, 1);
+        job_system::set_global(nullptr);
+
+        if(N_thread==1)
+            time_one_thread = time;
+        out<<"Threads: "<<N_thread<<" - CPU time per frame: "<<1000*time<<" ms - speedup: "<<time_one_thread/time
+           <<" - snow checksum: "<<std::hex<<snowfall.checksum()<<std::dec<<std::endl;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+
+// Options given on the command line
+struct benchmark_parameters
+{
+    int frames = 0; // number of frames rendered in benchmark mode (0: interactive mode)
+    int culling_objects = 0; // number of random objects of the culling benchmark (0: not run)
+    int noise_resolution = 0; // size N of the N x N heightmap of the noise benchmark (0: not run)
+    int terrain_resolution = 0; // size N of the N x N terrain mesh of the terrain benchmark (0: not run)
+    bool mesh_loading = false;  // compare the loading times of the OBJ and binary meshes
+    int lights = 0; // number of random spotlights of the light clustering benchmark (0: not run)
+    int snowflakes = 0; // number of flakes of the precipitation benchmark (0: not run)
+    int job_frames = 0; // number of frames per number of threads of the job system benchmark (0: not run)
+};
+//  --benchmark N : render N frames in a hidden window and print the statistics
+//  --benchmark-culling N : cull N random objects on the CPU only (no window) and print the timings
+//  --benchmark-noise N : generate a N x N heightmap of Perlin noise on one thread (no window) and print the timings
+//  --benchmark-terrain N : build the N x N terrain mesh on all the threads (no window) and print the timings
+//  --benchmark-mesh-loading : load the meshes of the assets from the OBJ and binary files (no window) and print the timings
+//  --benchmark-lights N : bin N random spotlights in the light clusters on the CPU only (no window) and print the timings
+//  --benchmark-snow N : simulate N snowflakes falling on the terrain (no window), print the timings and a checksum of the result
+//  --benchmark-jobs N : run N frames of the CPU tasks of the scene (no window) with 1, 2, 4 ... threads and print the time per frame
+benchmark_parameters parse_benchmark_arguments(int argc, char* argv[]);
+
+// Build a hierarchy over N random bounding spheres and cull it from a rotating camera
+void benchmark_culling(size_t N, std::ostream& out);
+
+// Generate a N x N heightmap with the batch noise kernel, compare with vcl::noise_perlin on a subset of the rows
+void benchmark_noise(size_t N, std::ostream& out);
+
+// Time create_terrain(N) (positions, uv, triangles and normals)
+void benchmark_terrain(unsigned int N, std::ostream& out);
+
+// Loading time of each OBJ asset and of its binary version (see mesh_binary.hpp)
+void benchmark_mesh_loading(std::ostream& out);
+
+// Bin N spotlights scattered along lines of lamps in the clusters of a rotating camera, check the lists against a brute force search
+void benchmark_lights(size_t N, std::ostream& out);
+
+// Emit N flakes over the whole height of the emitter then run 2 s of fixed steps against the terrain heightfield
+//  The checksum only depends on N and the seed: it must be the same on every run, whatever the number of threads
+void benchmark_snow(size_t N, std::ostream& out);
+
+// Run the CPU tasks of a frame (snow, flock, light clusters, culling, terrain chunk) as jobs, with an increasing number of threads
+//  The snow checksum printed for each number of threads must be the same
+void benchmark_jobs(size_t frames, std::ostream& out);
+
+// Counters measured on each frame
+struct frame_statistics
+{
+    void start_frame();
+    void end_frame();
+    void print(std::ostream& out) const;
+
+    size_t draw_calls = 0;        // draw calls of the current frame
+    size_t last_draw_calls = 0;   // draw calls of the last completed frame (displayed while the current one is drawn)
+    double cpu_time = 0;          // CPU time of the last frame (s)
+    size_t frames = 0;            // number of completed frames
+    size_t total_draw_calls = 0;
+    double total_cpu_time = 0;
+    std::chrono::steady_clock::time_point frame_start;
+};
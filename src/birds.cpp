@@ -1,33 +1,47 @@
 #include "birds.hpp"
+#include "mesh_cache.hpp"
+
+#include <algorithm>
 
 using namespace vcl;
 using namespace std;
 
+// Apparent radius of a bird (wings included)
+static float const bird_radius = 0.6f;
+
 
-hierarchy_mesh_drawable create_birds()
+hierarchy_mesh_drawable create_birds(float detail)
 {
     hierarchy_mesh_drawable hierarchy;
 
+    // Tessellation of the curved parts, scaled by the level of detail
+    int const N_high = std::max(4, int(40*detail));
+    int const N_low = std::max(4, int(20*detail));
+
     float const radius_head = 0.03f;
     float const radius_eye = 0.01f;
     float const radius_beak = 0.01f;
 
     vec3 const shape = {0.07f,0.19f,0.05f};
 
+    // The meshes of the curved parts are read from the cache when they have already been generated with this tessellation
+    cache_key const key_high = cache_key().add(birds_revision).add(N_high);
+    cache_key const key_low = cache_key().add(birds_revision).add(N_low);
+
     // The geometry of the body is a sphere
-    mesh_drawable body = mesh_drawable( mesh_primitive_ellipsoid(shape, {0,0,0}, 40, 40));
+    mesh_drawable body = mesh_drawable( cached_mesh("bird_body", key_high, [&](){ return mesh_primitive_ellipsoid(shape, {0,0,0}, N_high, N_high); }));
     body.shading.color = {0,0,0};
 
         // Geometry of the eyes: black spheres
-    mesh_drawable eye = mesh_drawable(mesh_primitive_sphere(radius_eye, {0,0,0}, 20, 20));
+    mesh_drawable eye = mesh_drawable(cached_mesh("bird_eye", key_low, [&](){ return mesh_primitive_sphere(radius_eye, {0,0,0}, N_low, N_low); }));
     eye.shading.color = {0,1,0};
 
         //Geometry of the head : white sphere
-    mesh_drawable head = mesh_drawable(mesh_primitive_sphere(radius_head, {0,0,0}, 40, 40));
+    mesh_drawable head = mesh_drawable(cached_mesh("bird_head", key_high, [&](){ return mesh_primitive_sphere(radius_head, {0,0,0}, N_high, N_high); }));
     head.shading.color = {0,0,0};
 
         //Geometry of the beak
-    mesh_drawable beak = mesh_drawable(mesh_primitive_cone(radius_beak, 0.05f, {0,0,0} , vec3(0,1,0),true, 40, 40));
+    mesh_drawable beak = mesh_drawable(cached_mesh("bird_beak", key_high, [&](){ return mesh_primitive_cone(radius_beak, 0.05f, {0,0,0} , vec3(0,1,0),true, N_high, N_high); }));
     beak.shading.color = {202,20,0};
 
     //position shoulder_left
@@ -91,3 +105,91 @@ hierarchy_mesh_drawable create_birds()
 
     return hierarchy;
 }
+
+float bird_wing_angle(float t)
+{
+    return 0.8f*std::sin(5.5f*3.14f*(t-0.15f));
+}
+
+void evaluate_birds(hierarchy_compiled const& bird, std::vector<bird_pose> const& poses, std::vector<instance_data>& world)
+{
+    // Nodes animated by the pose
+    size_t const body = bird.index("body");
+    size_t const shoulder_left = bird.index("shoulder_left");
+    size_t const shoulder_right = bird.index("shoulder_right");
+
+    bird.evaluate(poses.size(), [&](size_t i, size_t k, affine_rts& T) {
+        bird_pose const& pose = poses[i];
+        if(k==body) {
+            T.translate = pose.position;
+            T.rotate = rotation({0,0,1}, pose.heading);
+        }
+        else if(k==shoulder_left)
+            T.rotate = rotation({0,0.7f,0}, -pose.wing_angle);
+        else if(k==shoulder_right)
+            T.rotate = rotation({0,0.7f,0}, pose.wing_angle);
+    }, world);
+}
+
+
+void bird_lod::initialize(GLuint impostor_shader, GLuint impostor_texture)
+{
+    for(size_t k=0; k<levels.size(); ++k)
+        levels[k] = hierarchy_compiled(create_birds(1.0f/(1<<k))); // 40, 20, 10 and 5 subdivisions
+
+    // The impostor is a square facing the camera, textured with the image of a bird
+    mesh_drawable quad = mesh_drawable(mesh_primitive_quadrangle({-1,0,-1},{1,0,-1},{1,0,1},{-1,0,1}));
+    quad.texture = impostor_texture;
+    impostor = mesh_drawable_instanced(quad, impostor_shader);
+}
+
+int bird_lod::level(vec3 const& p, vec3 const& camera_position, float pixels_per_unit) const
+{
+    // Projected radius in pixels at the distance of the bird
+    float const d = std::max(norm(p-camera_position), 1e-3f);
+    float const radius_pixel = bird_radius*pixels_per_unit/d;
+
+    for(size_t k=0; k<pixel_threshold.size(); ++k)
+        if(radius_pixel>pixel_threshold[k])
+            return int(k);
+    return int(pixel_threshold.size()); // impostor
+}
+
+void bird_lod::update(std::vector<bird_pose> const& poses, vec3 const& camera_position, float pixels_per_unit, frustum const& view)
+{
+    for(std::vector<bird_pose>& p : level_poses)
+        p.clear();
+    impostor_instances.clear();
+
+    for(bird_pose const& pose : poses) {
+        if(!view.intersect({pose.position, bird_radius}))
+            continue;
+        int const k = level(pose.position, camera_position, pixels_per_unit);
+        if(k<int(levels.size()))
+            level_poses[k].push_back(pose);
+        else {
+            // Square facing the camera: local x -> right, local z -> up, local y -> toward the bird
+            vec3 const d = normalize(pose.position-camera_position);
+            vec3 right = cross(d, vec3(0,0,1));
+            right = norm(right)>1e-4f ? normalize(right) : vec3(1,0,0);
+            vec3 const up = cross(right, d);
+
+            instance_data instance;
+            instance.model = mat4::identity();
+            for(int i=0; i<3; ++i) {
+                instance.model(i,0) = bird_radius*right[i];
+                instance.model(i,1) = bird_radius*d[i];
+                instance.model(i,2) = bird_radius*up[i];
+                instance.model(i,3) = pose.position[i];
+            }
+            instance.color = {1,1,1};
+            impostor_instances.push_back(instance);
+        }
+    }
+
+    for(size_t k=0; k<levels.size(); ++k) {
+        evaluate_birds(levels[k], level_poses[k], world);
+        levels[k].update(world, level_poses[k].size());
+    }
+    impostor.update(impostor_instances);
+}
@@ -1,5 +1,56 @@
 #pragma once
 
 #include "vcl/vcl.hpp"
+#include "hierarchy_compiled.hpp"
+#include "culling.hpp"
+#include <array>
 
-vcl::hierarchy_mesh_drawable create_birds();
+// Bird hierarchy, detail scales the tessellation of the body, head, eyes and beak (1: full resolution)
+vcl::hierarchy_mesh_drawable create_birds(float detail = 1.0f);
+// Revision of create_birds, added to the keys of the cached parts: increment it at each change of the geometry
+int const birds_revision = 1;
+
+// Pose of an animated bird
+struct bird_pose
+{
+    vcl::vec3 position;
+    float heading;    // rotation around the vertical axis
+    float wing_angle; // rotation of the shoulders
+};
+
+// Wings flapping at time t
+float bird_wing_angle(float t);
+
+// World matrices of the parts of every bird in a single pass (see hierarchy_compiled::evaluate)
+void evaluate_birds(hierarchy_compiled const& bird, std::vector<bird_pose> const& poses, std::vector<instance_data>& world);
+
+/** Birds displayed with a level of detail chosen from their projected size on screen
+*  - 4 tessellations of the hierarchy (levels 0 to 3), then a textured square facing the camera (impostor)
+*  - update() sorts the birds by level, draw() issues one instanced draw call per part and per level */
+struct bird_lod
+{
+    void initialize(GLuint impostor_shader, GLuint impostor_texture);
+
+    // Level of a bird at position p: 0 to 3 for the meshes, 4 for the impostor
+    //  pixels_per_unit: size in pixels of an object of size 1 at distance 1 from the camera
+    int level(vcl::vec3 const& p, vcl::vec3 const& camera_position, float pixels_per_unit) const;
+    // The birds outside of the view frustum are discarded
+    void update(std::vector<bird_pose> const& poses, vcl::vec3 const& camera_position, float pixels_per_unit, frustum const& view);
+
+    std::array<hierarchy_compiled, 4> levels;
+    std::array<float, 4> pixel_threshold = {{60.0f, 25.0f, 10.0f, 4.0f}}; // minimal projected radius of each level
+    mesh_drawable_instanced impostor;
+
+private:
+    std::array<std::vector<bird_pose>, 4> level_poses;
+    std::vector<instance_data> world;
+    std::vector<instance_data> impostor_instances;
+};
+
+template <typename SCENE>
+void draw(bird_lod const& birds, SCENE const& scene)
+{
+    for(hierarchy_compiled const& level : birds.levels)
+        draw(level, scene);
+    draw(birds.impostor, scene);
+}
@@ -0,0 +1,239 @@
+#include "clustered_lighting.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace vcl;
+
+// Squared distance between a point and a box (0 inside)
+static float distance_squared(bounding_box const& box, vec3 const& p)
+{
+    float d2 = 0;
+    for(int k=0; k<3; ++k) {
+        float const d = std::max({box.p_min[k]-p[k], 0.0f, p[k]-box.p_max[k]});
+        d2 += d*d;
+    }
+    return d2;
+}
+
+static void create_texture_buffer(GLuint& buffer, GLuint& texture, GLenum format)
+{
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_DYNAMIC_DRAW);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Replace the content of a texture buffer (never empty: a zero size buffer cannot be attached)
+template <typename T>
+static void upload_texture_buffer(GLuint buffer, std::vector<T> const& data)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, GLsizeiptr(std::max<size_t>(data.size()*sizeof(T), 16)), nullptr, GL_DYNAMIC_DRAW);
+    if(!data.empty())
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, GLsizeiptr(data.size()*sizeof(T)), data.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+static void bind_texture_buffer(GLint unit, GLuint texture)
+{
+    glActiveTexture(GLenum(GL_TEXTURE0+unit));
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+}
+
+
+void light_clusters::initialize()
+{
+    create_texture_buffer(buffer_grid, texture_grid, GL_RG32UI);
+    create_texture_buffer(buffer_indices, texture_indices, GL_R32UI);
+    create_texture_buffer(buffer_lights, texture_lights, GL_RGBA32F);
+}
+
+size_t light_clusters::size() const
+{
+    return size_t(tiles_x)*tiles_y*slices;
+}
+
+void light_clusters::build_boxes(mat4 const& projection)
+{
+    // Perspective projection: x_ndc = P(0,0)*x/depth, y_ndc = P(1,1)*y/depth, near and far from the third row
+    float const a = projection(2,2);
+    float const b = projection(2,3);
+    float const n = b/(a-1);
+    float const f = b/(a+1);
+    if(boxes.size()==size() && projection_x==projection(0,0) && projection_y==projection(1,1) && z_near==n && z_far==f)
+        return;
+
+    projection_x = projection(0,0);
+    projection_y = projection(1,1);
+    z_near = n;
+    z_far = f;
+    slice_scale = slices/std::log(z_far/z_near);
+    slice_bias = -slice_scale*std::log(z_near);
+
+    boxes.assign(size(), bounding_box());
+    for(unsigned int s=0; s<slices; ++s)
+    {
+        float const depth[2] = {z_near*std::pow(z_far/z_near, s/float(slices)), z_near*std::pow(z_far/z_near, (s+1)/float(slices))};
+        for(unsigned int j=0; j<tiles_y; ++j)
+        {
+            float const y_ndc[2] = {-1+2*j/float(tiles_y), -1+2*(j+1)/float(tiles_y)};
+            for(unsigned int i=0; i<tiles_x; ++i)
+            {
+                float const x_ndc[2] = {-1+2*i/float(tiles_x), -1+2*(i+1)/float(tiles_x)};
+                bounding_box& box = boxes[i+tiles_x*(j+tiles_y*s)];
+                for(float d : depth)
+                    for(float x : x_ndc)
+                        for(float y : y_ndc)
+                            box.extend({vec3(x*d/projection_x, y*d/projection_y, d), 0.0f});
+            }
+        }
+    }
+}
+
+size_t light_clusters::cluster(vec3 const& p_view) const
+{
+    float const d = std::max(p_view.z, z_near);
+    auto const index = [](float t, unsigned int N) { return std::min(unsigned(std::max(t, 0.0f)*N), N-1); };
+    unsigned int const i = index(0.5f*(projection_x*p_view.x/d+1), tiles_x);
+    unsigned int const j = index(0.5f*(projection_y*p_view.y/d+1), tiles_y);
+    unsigned int const s = std::min(unsigned(std::max(std::log(d)*slice_scale+slice_bias, 0.0f)), slices-1);
+    return i+tiles_x*(j+tiles_y*s);
+}
+
+static bool same_matrix(mat4 const& a, mat4 const& b)
+{
+    return std::memcmp(ptr(a), ptr(b), 16*sizeof(float))==0;
+}
+
+bool light_clusters::bin(mat4 const& projection, mat4 const& view, light_registry const& registry)
+{
+    if(binned_version==registry.version && same_matrix(projection, binned_projection) && same_matrix(view, binned_view))
+        return false;
+    binned_projection = projection;
+    binned_view = view;
+    lists_modified = true;
+
+    build_boxes(projection);
+
+    // Data of the lights for the shader, only rebuilt when they changed
+    light_count = registry.size();
+    if(binned_version!=registry.version)
+    {
+        lights.resize(8*light_count);
+        for(size_t k=0; k<light_count; ++k)
+        {
+            vec3 const& p = registry.position[k];
+            vec3 const& c = registry.color[k];
+            float* data = &lights[8*k];
+            data[0] = p.x; data[1] = p.y; data[2] = p.z; data[3] = registry.radius[k];
+            data[4] = c.x; data[5] = c.y; data[6] = c.z; data[7] = 0.0f;
+        }
+        binned_version = registry.version;
+    }
+
+    // Lights intersecting the view frustum, in view space with a positive depth
+    frustum const view_frustum(projection*view);
+    std::vector<uint32_t> visible;
+    std::vector<vec3> p_view;
+    std::vector<float> radius;
+    for(size_t k=0; k<light_count; ++k)
+    {
+        if(!view_frustum.intersect(registry.bounds(k)))
+            continue;
+        vec4 const q = view*vec4(registry.position[k], 1.0f);
+        visible.push_back(uint32_t(k));
+        p_view.push_back({q.x, q.y, -q.z});
+        radius.push_back(registry.radius[k]);
+    }
+    visible_lights = visible.size();
+
+    // Each depth slice is binned by one thread: only the lights overlapping the slice are tested against its rows of tiles,
+    //  and only the lights overlapping a row are tested against its tiles
+    size_t const tiles = size_t(tiles_x)*tiles_y;
+    lists.resize(size());
+    parallel_for(0, slices, [&](size_t s_begin, size_t s_end) {
+        std::vector<uint32_t> candidates, row_candidates;
+        for(size_t s=s_begin; s<s_end; ++s)
+        {
+            float const d_min = boxes[tiles*s].p_min.z;
+            float const d_max = boxes[tiles*s].p_max.z;
+            candidates.clear();
+            for(size_t k=0; k<visible_lights; ++k)
+                if(p_view[k].z+radius[k]>=d_min && p_view[k].z-radius[k]<=d_max)
+                    candidates.push_back(uint32_t(k));
+
+            for(size_t j=0; j<tiles_y; ++j)
+            {
+                size_t const first = tiles_x*(j+tiles_y*s);
+                bounding_box row = boxes[first];
+                for(size_t i=1; i<tiles_x; ++i)
+                    for(int c=0; c<3; ++c) {
+                        row.p_min[c] = std::min(row.p_min[c], boxes[first+i].p_min[c]);
+                        row.p_max[c] = std::max(row.p_max[c], boxes[first+i].p_max[c]);
+                    }
+                row_candidates.clear();
+                for(uint32_t k : candidates)
+                    if(distance_squared(row, p_view[k])<=radius[k]*radius[k])
+                        row_candidates.push_back(k);
+
+                for(size_t i=0; i<tiles_x; ++i)
+                {
+                    std::vector<uint32_t>& list = lists[first+i];
+                    list.clear();
+                    for(uint32_t k : row_candidates)
+                        if(distance_squared(boxes[first+i], p_view[k])<=radius[k]*radius[k])
+                            list.push_back(visible[k]);
+                }
+            }
+        }
+    });
+
+    // Concatenate the lists
+    grid.resize(2*size());
+    indices.clear();
+    max_cluster_lights = 0;
+    for(size_t c=0; c<size(); ++c)
+    {
+        grid[2*c] = uint32_t(indices.size());
+        grid[2*c+1] = uint32_t(lists[c].size());
+        indices.insert(indices.end(), lists[c].begin(), lists[c].end());
+        max_cluster_lights = std::max(max_cluster_lights, lists[c].size());
+    }
+    return true;
+}
+
+void light_clusters::upload(light_registry const& registry)
+{
+    if(lists_modified) {
+        upload_texture_buffer(buffer_grid, grid);
+        upload_texture_buffer(buffer_indices, indices);
+        lists_modified = false;
+    }
+
+    // All the lights are sent when the static ones changed, otherwise only the dynamic ones (stored after the static ones)
+    if(uploaded_static_version!=registry.static_version || uploaded_size!=light_count) {
+        upload_texture_buffer(buffer_lights, lights);
+        uploaded_static_version = registry.static_version;
+        uploaded_size = light_count;
+        uploaded_version = registry.version;
+    }
+    else if(uploaded_version!=registry.version && registry.dynamic_count()>0) {
+        size_t const offset = 8*registry.static_count;
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer_lights);
+        glBufferSubData(GL_TEXTURE_BUFFER, GLintptr(offset*sizeof(float)), GLsizeiptr((lights.size()-offset)*sizeof(float)), &lights[offset]);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        uploaded_version = registry.version;
+    }
+
+    bind_texture_buffer(unit_grid, texture_grid);
+    bind_texture_buffer(unit_indices, texture_indices);
+    bind_texture_buffer(unit_lights, texture_lights);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include "culling.hpp"
+#include "lights.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/** Clustered forward lighting: the view frustum is divided into tiles_x x tiles_y screen tiles and slices depth slices
+*  (exponential in depth), and each cluster receives the list of the spotlights whose radius reaches it
+*  - bin() runs on the CPU (the depth slices are split across the threads), upload() sends the lists to texture buffers
+*  - Nothing is recomputed when neither the view nor the lights changed, and the static lights are only sent again when they changed
+*  - The fragment shader finds its cluster from gl_FragCoord and its depth, and only shades the lights of the list
+*     (see shader/mesh_lights.frag.glsl), so the cost per pixel depends on the local density of lights
+*  - GPU data: grid (offset,count) per cluster, light indices, and 2 RGBA texels per light (position,radius) and (color,0) */
+struct light_clusters
+{
+    // Texture units of the texture buffers, the unit 0 is used by the texture of the meshes
+    static constexpr GLint unit_grid = 1;
+    static constexpr GLint unit_indices = 2;
+    static constexpr GLint unit_lights = 3;
+
+    // Create the texture buffers (the binning alone does not need OpenGL)
+    void initialize();
+    // Build the lists of the clusters for the current view (projection from projection_perspective)
+    //  Only the lights whose sphere of influence intersects the view frustum are binned. Return false when the lists are unchanged
+    bool bin(vcl::mat4 const& projection, vcl::mat4 const& view, light_registry const& registry);
+    // Send the modified lists and lights to the GPU, and bind the texture buffers to their units
+    void upload(light_registry const& registry);
+
+    size_t size() const; // number of clusters
+    // Cluster containing the view space point (x, y, depth>0) in the current frustum, as computed by the fragment shader
+    size_t cluster(vcl::vec3 const& p_view) const;
+
+    unsigned int tiles_x = 16;
+    unsigned int tiles_y = 9;
+    unsigned int slices = 24;
+
+    // Frustum of the clusters, extracted from the projection
+    float z_near = 0.1f;
+    float z_far = 100.0f;
+    float slice_scale = 0; // slice = log(depth)*slice_scale + slice_bias
+    float slice_bias = 0;
+
+    std::vector<bounding_box> boxes;     // view space boxes of the clusters with a positive depth, index: x + tiles_x*(y + tiles_y*slice)
+    std::vector<uint32_t> grid;          // (offset,count) of the list of each cluster in indices
+    std::vector<uint32_t> indices;       // lists of lights of all the clusters
+    std::vector<float> lights;           // 8 floats per light: position, radius, color, 0
+    size_t light_count = 0;
+    size_t visible_lights = 0;           // lights intersecting the view frustum at the last binning
+    size_t max_cluster_lights = 0;       // longest list of the last binning
+
+    GLuint buffer_grid = 0, texture_grid = 0;
+    GLuint buffer_indices = 0, texture_indices = 0;
+    GLuint buffer_lights = 0, texture_lights = 0;
+
+private:
+    void build_boxes(vcl::mat4 const& projection);
+    float projection_x = 0, projection_y = 0; // projection(0,0) and projection(1,1) used for the boxes
+    std::vector<std::vector<uint32_t>> lists; // lists of each cluster before compaction
+
+    // State of the last binning and upload
+    vcl::mat4 binned_projection, binned_view;
+    size_t binned_version = 0;
+    bool lists_modified = false;
+    size_t uploaded_version = 0, uploaded_static_version = 0, uploaded_size = 0;
+};
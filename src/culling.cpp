@@ -0,0 +1,187 @@
+#include "culling.hpp"
+
+#include <algorithm>
+
+using namespace vcl;
+
+bounding_sphere bounding_sphere_of(mesh const& shape)
+{
+    bounding_sphere sphere;
+    if(shape.position.size()==0)
+        return sphere;
+
+    vec3 p_min = shape.position[0], p_max = shape.position[0];
+    for(vec3 const& p : shape.position) {
+        for(int i=0; i<3; ++i) {
+            p_min[i] = std::min(p_min[i], p[i]);
+            p_max[i] = std::max(p_max[i], p[i]);
+        }
+    }
+    sphere.center = (p_min+p_max)/2.0f;
+    for(vec3 const& p : shape.position)
+        sphere.radius = std::max(sphere.radius, norm(p-sphere.center));
+    return sphere;
+}
+
+bounding_sphere transform_bounding_sphere(bounding_sphere const& sphere, affine_rts const& transform)
+{
+    bounding_sphere result;
+    result.center = transform.rotate*(transform.scale*sphere.center) + transform.translate;
+    result.radius = std::abs(transform.scale)*sphere.radius;
+    return result;
+}
+
+void bounding_box::extend(bounding_sphere const& sphere)
+{
+    for(int i=0; i<3; ++i) {
+        p_min[i] = std::min(p_min[i], sphere.center[i]-sphere.radius);
+        p_max[i] = std::max(p_max[i], sphere.center[i]+sphere.radius);
+    }
+}
+
+
+frustum::frustum()
+{}
+
+frustum::frustum(mat4 const& M)
+{
+    // Planes from the combinations of the rows of the matrix: row3 + row_k and row3 - row_k
+    for(int k=0; k<3; ++k) {
+        for(int s=0; s<2; ++s) {
+            float const sign = s==0 ? 1.0f : -1.0f;
+            vec4 plane;
+            for(int j=0; j<4; ++j)
+                plane[j] = M(3,j) + sign*M(k,j);
+            float const n = std::sqrt(plane.x*plane.x+plane.y*plane.y+plane.z*plane.z);
+            planes[2*k+s] = (1.0f/n)*plane;
+        }
+    }
+}
+
+bool frustum::intersect(bounding_sphere const& sphere) const
+{
+    vec3 const& c = sphere.center;
+    for(vec4 const& P : planes)
+        if(P.x*c.x+P.y*c.y+P.z*c.z+P.w < -sphere.radius)
+            return false;
+    return true;
+}
+
+int frustum::classify(bounding_box const& box) const
+{
+    int result = 1;
+    for(vec4 const& P : planes) {
+        // Corner the furthest along the normal (p) and the opposite one (n)
+        vec3 p, n;
+        for(int i=0; i<3; ++i) {
+            p[i] = P[i]>=0 ? box.p_max[i] : box.p_min[i];
+            n[i] = P[i]>=0 ? box.p_min[i] : box.p_max[i];
+        }
+        if(P.x*p.x+P.y*p.y+P.z*p.z+P.w < 0)
+            return -1;
+        if(P.x*n.x+P.y*n.y+P.z*n.z+P.w < 0)
+            result = 0;
+    }
+    return result;
+}
+
+
+void bvh::build(std::vector<bounding_sphere> const& objects)
+{
+    size_t const leaf_size = 4;
+
+    spheres = objects;
+    size_t const N = objects.size();
+    index.resize(N);
+    for(size_t k=0; k<N; ++k)
+        index[k] = uint32_t(k);
+    nodes.clear();
+    if(N==0)
+        return;
+    nodes.reserve(2*N/leaf_size+1);
+
+    // Iterative construction: (node, first object, number of objects)
+    struct task { uint32_t node, first, count; };
+    std::vector<task> stack;
+    nodes.push_back(node());
+    stack.push_back({0, 0, uint32_t(N)});
+    while(!stack.empty())
+    {
+        task const current = stack.back();
+        stack.pop_back();
+
+        bounding_box box, box_center;
+        for(uint32_t k=current.first; k<current.first+current.count; ++k) {
+            box.extend(spheres[index[k]]);
+            box_center.extend({spheres[index[k]].center, 0.0f});
+        }
+        nodes[current.node].box = box;
+
+        if(current.count<=leaf_size) {
+            nodes[current.node].first = current.first;
+            nodes[current.node].count = current.count;
+            continue;
+        }
+
+        // Median split along the largest axis of the centers
+        vec3 const extent = box_center.p_max-box_center.p_min;
+        int const axis = extent.x>extent.y ? (extent.x>extent.z ? 0 : 2) : (extent.y>extent.z ? 1 : 2);
+        uint32_t const half = current.count/2;
+        auto const first = index.begin()+current.first;
+        std::nth_element(first, first+half, first+current.count, [&](uint32_t a, uint32_t b) {
+            return spheres[a].center[axis] < spheres[b].center[axis];
+        });
+
+        uint32_t const child = uint32_t(nodes.size());
+        nodes.push_back(node());
+        nodes.push_back(node());
+        nodes[current.node].first = child;
+        nodes[current.node].count = 0;
+        stack.push_back({child, current.first, half});
+        stack.push_back({child+1, current.first+half, current.count-half});
+    }
+}
+
+size_t bvh::size() const
+{
+    return spheres.size();
+}
+
+void bvh::cull(frustum const& view, std::vector<uint32_t>& visible) const
+{
+    visible.clear();
+    if(!nodes.empty())
+        cull_node(0, view, visible);
+}
+
+void bvh::cull_node(uint32_t k, frustum const& view, std::vector<uint32_t>& visible) const
+{
+    node const& current = nodes[k];
+    int const status = view.classify(current.box);
+    if(status<0)
+        return;
+
+    if(current.count>0) {
+        for(uint32_t i=current.first; i<current.first+current.count; ++i)
+            if(status>0 || view.intersect(spheres[index[i]]))
+                visible.push_back(index[i]);
+    }
+    else if(status>0) {
+        // Fully inside: every object below is visible, no more test needed
+        std::vector<uint32_t> stack = {k};
+        while(!stack.empty()) {
+            node const& n = nodes[stack.back()];
+            stack.pop_back();
+            if(n.count>0)
+                visible.insert(visible.end(), index.begin()+n.first, index.begin()+n.first+n.count);
+            else {
+                stack.push_back(n.first);
+                stack.push_back(n.first+1);
+            }
+        }
+    }
+    else {
+        cull_node(current.first, view, visible);
+        cull_node(current.first+1, view, visible);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct bounding_sphere
+{
+    vcl::vec3 center;
+    float radius = 0.0f;
+};
+
+// Sphere containing all the positions of a mesh (center of its bounding box)
+bounding_sphere bounding_sphere_of(vcl::mesh const& shape);
+// Sphere containing a transformed sphere
+bounding_sphere transform_bounding_sphere(bounding_sphere const& sphere, vcl::affine_rts const& transform);
+
+struct bounding_box
+{
+    vcl::vec3 p_min = { 1e30f, 1e30f, 1e30f};
+    vcl::vec3 p_max = {-1e30f,-1e30f,-1e30f};
+    void extend(bounding_sphere const& sphere);
+};
+
+/** The 6 planes of a view frustum extracted from projection*view
+*  - A point p is inside when dot(n,p)+d >= 0 for each plane (n,d) */
+struct frustum
+{
+    frustum();
+    frustum(vcl::mat4 const& projection_view);
+
+    bool intersect(bounding_sphere const& sphere) const;
+    // -1: outside, 0: intersect, 1: fully inside
+    int classify(bounding_box const& box) const;
+
+    std::array<vcl::vec4, 6> planes;
+};
+
+/** Bounding volume hierarchy over a set of bounding spheres
+*  - Binary tree of boxes built by median split along the largest axis
+*  - cull() only visits the nodes intersecting the frustum, and does not test the objects of the nodes fully inside */
+struct bvh
+{
+    void build(std::vector<bounding_sphere> const& objects);
+    // Indices of the objects intersecting the frustum (visible is cleared first)
+    void cull(frustum const& view, std::vector<uint32_t>& visible) const;
+    size_t size() const;
+
+    struct node
+    {
+        bounding_box box;
+        uint32_t first;  // leaf: first object in index / internal node: index of the first child (the second one follows)
+        uint32_t count;  // number of objects for a leaf, 0 for an internal node
+    };
+    std::vector<node> nodes;
+    std::vector<uint32_t> index;         // objects sorted by leaf
+    std::vector<bounding_sphere> spheres;
+
+private:
+    void cull_node(uint32_t k, frustum const& view, std::vector<uint32_t>& visible) const;
+};
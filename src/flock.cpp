@@ -0,0 +1,126 @@
+#include "flock.hpp"
+#include "parallel.hpp"
+
+#include <cmath>
+
+using namespace vcl;
+
+uint32_t spatial_hash_grid::cell(int ix, int iy, int iz) const
+{
+    // Spatial hash of the cell coordinates, the table size is a power of 2
+    uint32_t const h = uint32_t(ix)*73856093u ^ uint32_t(iy)*19349663u ^ uint32_t(iz)*83492791u;
+    return h & uint32_t(cell_start.size()-2);
+}
+
+void spatial_hash_grid::build(std::vector<vec3> const& positions, float cell_size_arg)
+{
+    cell_size = cell_size_arg;
+    size_t const N = positions.size();
+
+    // Table size: power of 2 >= 2N
+    size_t table_size = 64;
+    while(table_size<2*N)
+        table_size *= 2;
+    cell_start.assign(table_size+1, 0);
+    cell_of_point.resize(N);
+    sorted_index.resize(N);
+
+    // Counting sort of the points by cell
+    for(size_t k=0; k<N; ++k) {
+        vec3 const& p = positions[k];
+        uint32_t const c = cell(int(std::floor(p.x/cell_size)), int(std::floor(p.y/cell_size)), int(std::floor(p.z/cell_size)));
+        cell_of_point[k] = c;
+        cell_start[c+1]++;
+    }
+    for(size_t c=0; c<table_size; ++c)
+        cell_start[c+1] += cell_start[c];
+
+    std::vector<uint32_t> offset(cell_start.begin(), cell_start.end()-1);
+    for(size_t k=0; k<N; ++k)
+        sorted_index[offset[cell_of_point[k]]++] = uint32_t(k);
+}
+
+
+void flock::initialize(size_t N, vec3 const& center, float radius)
+{
+    position.resize(N);
+    velocity.resize(N);
+    new_velocity.resize(N);
+    phase.resize(N);
+    for(size_t k=0; k<N; ++k) {
+        position[k] = center + radius*vec3(rand_interval(-1,1), rand_interval(-1,1), rand_interval(-0.3f,0.3f));
+        float const angle = rand_interval(0, 2*pi);
+        velocity[k] = parameters.speed_min*vec3(std::cos(angle), std::sin(angle), 0.0f);
+        phase[k] = rand_interval(0, 1);
+    }
+}
+
+size_t flock::size() const
+{
+    return position.size();
+}
+
+float flock::heading(size_t k) const
+{
+    return std::atan2(-velocity[k].x, velocity[k].y);
+}
+
+void flock::update(float dt, vec3 const& goal, heightfield const& field)
+{
+    size_t const N = position.size();
+    flock_parameters const& P = parameters;
+    grid.build(position, P.neighbor_radius);
+
+    float const r2 = P.neighbor_radius*P.neighbor_radius;
+    float const s2 = P.separation_radius*P.separation_radius;
+
+    parallel_for(0, N, [&](size_t b, size_t e) {
+        for(size_t k=b; k<e; ++k)
+        {
+            vec3 const& p = position[k];
+            vec3 separation = {0,0,0}, alignment = {0,0,0}, center = {0,0,0};
+            int N_neighbor = 0;
+
+            grid.for_each_neighbor(p, [&](uint32_t j) {
+                if(j==k || N_neighbor>=P.max_neighbors)
+                    return;
+                vec3 const d = position[j]-p;
+                float const d2 = dot(d,d);
+                if(d2>r2)
+                    return;
+                if(d2<s2 && d2>1e-8f)
+                    separation -= d/d2;
+                alignment += velocity[j];
+                center += position[j];
+                ++N_neighbor;
+            });
+
+            vec3 a = P.weight_goal*(goal-p);
+            if(N_neighbor>0) {
+                a += P.weight_separation*separation;
+                a += P.weight_alignment*(alignment/float(N_neighbor)-velocity[k]);
+                a += P.weight_cohesion*(center/float(N_neighbor)-p);
+            }
+
+            // Stay above the ground
+            float const z_min = field.height_world(p.x, p.y) + P.height_above_terrain;
+            if(p.z<z_min)
+                a.z += 4.0f*(z_min-p.z);
+
+            vec3 v = velocity[k] + dt*a;
+            float const speed = norm(v);
+            if(speed>P.speed_max)
+                v *= P.speed_max/speed;
+            else if(speed<P.speed_min && speed>1e-6f)
+                v *= P.speed_min/speed;
+            new_velocity[k] = v;
+        }
+    });
+
+    parallel_for(0, N, [&](size_t b, size_t e) {
+        for(size_t k=b; k<e; ++k) {
+            velocity[k] = new_velocity[k];
+            position[k] += dt*velocity[k];
+        }
+    });
+}
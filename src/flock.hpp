@@ -0,0 +1,90 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include "heightfield.hpp"
+#include <vector>
+#include <cstdint>
+
+/** Uniform grid over the space, stored as a hash table of cells
+*  - Rebuilt from scratch by a counting sort of the points into their cells
+*  - Neighbors of a point are searched in the 27 cells around it */
+struct spatial_hash_grid
+{
+    void build(std::vector<vcl::vec3> const& positions, float cell_size);
+
+    // Call f(j) for every point j in the cells around p (may include points further than cell_size)
+    template <typename F> void for_each_neighbor(vcl::vec3 const& p, F const& f) const;
+
+    float cell_size = 1.0f;
+    std::vector<uint32_t> cell_start;  // first index in sorted_index of each cell (size: number of cells + 1)
+    std::vector<uint32_t> sorted_index; // index of the points sorted by cell
+    std::vector<uint32_t> cell_of_point;
+
+private:
+    uint32_t cell(int ix, int iy, int iz) const;
+};
+
+struct flock_parameters
+{
+    float neighbor_radius = 0.8f;    // radius of perception (also the size of the grid cells)
+    float separation_radius = 0.25f;
+    float weight_separation = 2.0f;
+    float weight_alignment = 1.0f;
+    float weight_cohesion = 0.6f;
+    float weight_goal = 0.8f;        // attraction toward the goal (the leading bird)
+    float speed_min = 1.0f;
+    float speed_max = 3.0f;
+    float height_above_terrain = 3.0f;
+    int max_neighbors = 32;          // bound the cost in dense regions
+};
+
+/** Boids flock: separation, alignment and cohesion with the neighbors + attraction toward a goal
+*  - Neighbors found with the spatial hash grid rebuilt at each step
+*  - The birds are updated in parallel (the new velocities only depend on the previous state) */
+struct flock
+{
+    void initialize(size_t N, vcl::vec3 const& center, float radius);
+    void update(float dt, vcl::vec3 const& goal, heightfield const& field);
+    size_t size() const;
+
+    // Orientation of the bird k around the vertical axis (the bird model looks toward +y)
+    float heading(size_t k) const;
+
+    flock_parameters parameters;
+    std::vector<vcl::vec3> position;
+    std::vector<vcl::vec3> velocity;
+    std::vector<float> phase;         // offset of the wings flapping
+    spatial_hash_grid grid;
+
+private:
+    std::vector<vcl::vec3> new_velocity;
+};
+
+
+template <typename F> void spatial_hash_grid::for_each_neighbor(vcl::vec3 const& p, F const& f) const
+{
+    int const ix = int(std::floor(p.x/cell_size));
+    int const iy = int(std::floor(p.y/cell_size));
+    int const iz = int(std::floor(p.z/cell_size));
+
+    uint32_t visited[27];
+    int N_visited = 0;
+    for(int dx=-1; dx<=1; ++dx) {
+        for(int dy=-1; dy<=1; ++dy) {
+            for(int dz=-1; dz<=1; ++dz) {
+                uint32_t const c = cell(ix+dx, iy+dy, iz+dz);
+
+                // Distinct cells may collide in the hash table: visit each entry once
+                bool already_visited = false;
+                for(int k=0; k<N_visited; ++k)
+                    already_visited = already_visited || visited[k]==c;
+                if(already_visited)
+                    continue;
+                visited[N_visited++] = c;
+
+                for(uint32_t k=cell_start[c]; k<cell_start[c+1]; ++k)
+                    f(sorted_index[k]);
+            }
+        }
+    }
+}
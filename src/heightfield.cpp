@@ -0,0 +1,130 @@
+#include "heightfield.hpp"
+#include "parallel.hpp"
+#include "mesh_cache.hpp"
+
+#include <algorithm>
+
+using namespace vcl;
+
+// The terrain covers [-10,10]^2 in world space (see evaluate_terrain)
+static float const terrain_size = 20.0f;
+
+void heightfield::build(perlin_noise_parameters const& parameters, unsigned int N_samples)
+{
+    N = N_samples;
+    z.resize(N*N);
+    n.resize(N*N);
+
+    parallel_for(0, N, [&](size_t b, size_t e) {
+        std::vector<vec3> row(N);
+        for(size_t ku=b; ku<e; ++ku) {
+            evaluate_terrain_grid_row(unsigned(ku), N, parameters, row.data());
+            for(unsigned int kv=0; kv<N; ++kv)
+                z[kv+N*ku] = row[kv].z;
+        }
+    });
+
+    // Normals from central differences on the samples (one-sided on the border)
+    float const h = terrain_size/(N-1.0f);
+    for(unsigned int ku=0; ku<N; ++ku)
+    {
+        unsigned int const ku0 = ku>0 ? ku-1 : ku;
+        unsigned int const ku1 = ku<N-1 ? ku+1 : ku;
+        for(unsigned int kv=0; kv<N; ++kv)
+        {
+            unsigned int const kv0 = kv>0 ? kv-1 : kv;
+            unsigned int const kv1 = kv<N-1 ? kv+1 : kv;
+            float const dzdx = (z[kv+N*ku1]-z[kv+N*ku0]) / ((ku1-ku0)*h);
+            float const dzdy = (z[kv1+N*ku]-z[kv0+N*ku]) / ((kv1-kv0)*h);
+            n[kv+N*ku] = normalize(vec3(-dzdx, -dzdy, 1.0f));
+        }
+    }
+
+    is_valid = true;
+}
+
+void heightfield::build_cached(perlin_noise_parameters const& parameters, unsigned int N_samples)
+{
+    cache_key const key = cache_key().add(terrain_revision).add(parameters).add(N_samples);
+    std::string const path = cache_path("heightfield", key);
+
+    cache_file file;
+    if(file.open(path, key) && file.size()==2 && file.read(0, z) && file.read(1, n) && z.size()==N_samples*N_samples && n.size()==z.size()) {
+        N = N_samples;
+        is_valid = true;
+        return;
+    }
+
+    build(parameters, N_samples);
+    if(create_directory(cache_directory))
+        write_cache_file(path, key, {make_cache_block(z), make_cache_block(n)});
+}
+
+void heightfield::invalidate()
+{
+    is_valid = false;
+}
+
+void heightfield::update(perlin_noise_parameters const& parameters)
+{
+    if(!is_valid)
+        build(parameters, N>1 ? N : 256);
+}
+
+bool heightfield::valid() const
+{
+    return is_valid;
+}
+
+// Cell (k0,k0+1) and local coordinate s \in [0,1] of a parametric coordinate along one axis
+static void locate(float u, unsigned int N, unsigned int& k0, float& s)
+{
+    float const x = std::min(std::max(u,0.0f),1.0f)*(N-1);
+    k0 = std::min(static_cast<unsigned int>(x), N-2);
+    s = x-k0;
+}
+
+float heightfield::height(float u, float v) const
+{
+    assert_vcl(is_valid, "heightfield used before build()");
+    unsigned int ku, kv;
+    float su, sv;
+    locate(u, N, ku, su);
+    locate(v, N, kv, sv);
+
+    float const z00 = z[kv  +N*ku];
+    float const z01 = z[kv+1+N*ku];
+    float const z10 = z[kv  +N*(ku+1)];
+    float const z11 = z[kv+1+N*(ku+1)];
+    return (1-su)*((1-sv)*z00+sv*z01) + su*((1-sv)*z10+sv*z11);
+}
+
+vec3 heightfield::position(float u, float v) const
+{
+    return {terrain_size*(u-0.5f), terrain_size*(v-0.5f), height(u,v)};
+}
+
+vec3 heightfield::normal(float u, float v) const
+{
+    assert_vcl(is_valid, "heightfield used before build()");
+    unsigned int ku, kv;
+    float su, sv;
+    locate(u, N, ku, su);
+    locate(v, N, kv, sv);
+
+    vec3 const& n00 = n[kv  +N*ku];
+    vec3 const& n01 = n[kv+1+N*ku];
+    vec3 const& n10 = n[kv  +N*(ku+1)];
+    vec3 const& n11 = n[kv+1+N*(ku+1)];
+    return normalize( (1-su)*((1-sv)*n00+sv*n01) + su*((1-sv)*n10+sv*n11) );
+}
+
+float heightfield::height_world(float x, float y) const
+{
+    return height(x/terrain_size+0.5f, y/terrain_size+0.5f);
+}
+
+vec3 heightfield::normal_world(float x, float y) const
+{
+    return normal(x/terrain_size+0.5f, y/terrain_size+0.5f);
+}
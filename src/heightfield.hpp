@@ -0,0 +1,34 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include "terrain.hpp"
+
+/** Precomputed samples of evaluate_terrain() over the (u,v) \in [0,1] domain
+*  - Built once from a set of perlin_noise_parameters, queries are then O(1) (bilinear interpolation)
+*  - Call invalidate() when the parameters change, the next update() rebuilds the samples */
+struct heightfield
+{
+    // Sample the terrain on a N x N grid
+    void build(perlin_noise_parameters const& parameters, unsigned int N = 256);
+    // Same as build(), the samples are read from the cache when they have already been computed with these parameters
+    void build_cached(perlin_noise_parameters const& parameters, unsigned int N = 256);
+    // Mark the samples as outdated
+    void invalidate();
+    // Rebuild the samples only if they have been invalidated
+    void update(perlin_noise_parameters const& parameters);
+    bool valid() const;
+
+    // Queries in parametric coordinates (u,v) \in [0,1] (clamped outside)
+    float height(float u, float v) const;
+    vcl::vec3 position(float u, float v) const; // Same result as evaluate_terrain(u,v) up to the interpolation
+    vcl::vec3 normal(float u, float v) const;
+
+    // Queries in world coordinates (x,y) \in [-10,10]
+    float height_world(float x, float y) const;
+    vcl::vec3 normal_world(float x, float y) const;
+
+    unsigned int N = 0;
+    vcl::buffer<float> z;         // height at sample (ku,kv) stored at kv+N*ku
+    vcl::buffer<vcl::vec3> n;     // normal at each sample
+    bool is_valid = false;
+};
@@ -0,0 +1,65 @@
+#include "hierarchy_compiled.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+
+using namespace vcl;
+
+hierarchy_compiled::hierarchy_compiled()
+{}
+
+hierarchy_compiled::hierarchy_compiled(hierarchy_mesh_drawable const& hierarchy)
+{
+    size_t const M = hierarchy.elements.size();
+
+    // Depth of each node: sorting by depth puts the parents before their children
+    std::map<std::string, size_t> element_index;
+    for(size_t k=0; k<M; ++k)
+        element_index[hierarchy.elements[k].name] = k;
+
+    std::vector<int> depth(M, -1);
+    std::function<int(size_t)> compute_depth = [&](size_t k) {
+        if(depth[k]<0) {
+            auto const it = element_index.find(hierarchy.elements[k].name_parent);
+            depth[k] = it==element_index.end() ? 0 : compute_depth(it->second)+1;
+        }
+        return depth[k];
+    };
+    std::vector<size_t> order(M);
+    for(size_t k=0; k<M; ++k) {
+        compute_depth(k);
+        order[k] = k;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){ return depth[a]<depth[b]; });
+
+    std::map<std::string, int> sorted_index;
+    for(size_t k=0; k<M; ++k) {
+        hierarchy_mesh_drawable_node const& node = hierarchy.elements[order[k]];
+        auto const it = sorted_index.find(node.name_parent);
+
+        name.push_back(node.name);
+        parent.push_back(it==sorted_index.end() ? -1 : it->second);
+        transform.push_back(node.transform);
+        drawable.push_back(mesh_drawable_instanced(node.element));
+        sorted_index[node.name] = int(k);
+    }
+}
+
+size_t hierarchy_compiled::index(std::string const& node_name) const
+{
+    auto const it = std::find(name.begin(), name.end(), node_name);
+    assert_vcl(it!=name.end(), "Cannot find the node "+node_name+" in the hierarchy");
+    return size_t(it-name.begin());
+}
+
+size_t hierarchy_compiled::size() const
+{
+    return parent.size();
+}
+
+void hierarchy_compiled::update(std::vector<instance_data> const& world, size_t N)
+{
+    for(size_t k=0; k<drawable.size(); ++k)
+        drawable[k].update(N>0 ? &world[k*N] : nullptr, N);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include "instancing.hpp"
+#include "parallel.hpp"
+#include <string>
+#include <vector>
+
+/** Index-based form of a hierarchy_mesh_drawable, evaluated for many instances at once
+*  - Nodes are sorted such that parent[k] < k (the root has parent -1)
+*  - The world matrices are packed per node: the N instances of node k are stored at [k*N, (k+1)*N[,
+*    ready to be sent to the instanced drawable of the node */
+struct hierarchy_compiled
+{
+    hierarchy_compiled();
+    hierarchy_compiled(vcl::hierarchy_mesh_drawable const& hierarchy);
+
+    // Index of a node (resolved once, outside of the animation loop)
+    size_t index(std::string const& name) const;
+    size_t size() const;
+
+    /** Compute the world matrices of N instances into world (resized to size()*N)
+    *   local(i, k, T) may modify T: the local transform of node k for instance i (initialized to the rest transform) */
+    template <typename F>
+    void evaluate(size_t N, F const& local, std::vector<instance_data>& world) const;
+
+    // Send the world matrices of the instances of each node to its drawable
+    void update(std::vector<instance_data> const& world, size_t N);
+
+    std::vector<std::string> name;
+    std::vector<int> parent;
+    std::vector<vcl::affine_rts> transform;              // rest local transform
+    std::vector<mesh_drawable_instanced> drawable;       // one instanced drawable per node
+};
+
+template <typename SCENE>
+void draw(hierarchy_compiled const& hierarchy, SCENE const& scene)
+{
+    for(mesh_drawable_instanced const& d : hierarchy.drawable)
+        draw(d, scene);
+}
+
+
+template <typename F>
+void hierarchy_compiled::evaluate(size_t N, F const& local, std::vector<instance_data>& world) const
+{
+    size_t const M = parent.size();
+    world.resize(M*N);
+
+    // The instances are independent: split them across the threads
+    parallel_for(0, N, [&](size_t b, size_t e) {
+        for(size_t i=b; i<e; ++i) {
+            for(size_t k=0; k<M; ++k) {
+                vcl::affine_rts T = transform[k];
+                local(i, k, T);
+                instance_data& w = world[k*N+i];
+                w.model = parent[k]<0 ? T.matrix() : world[parent[k]*N+i].model * T.matrix();
+                w.color = {1,1,1};
+            }
+        }
+    });
+}
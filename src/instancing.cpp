@@ -0,0 +1,96 @@
+#include "instancing.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+using namespace vcl;
+
+static_assert(sizeof(mat4)==16*sizeof(float), "instance_data expects a tightly packed mat4");
+
+GLuint mesh_drawable_instanced::default_shader = 0;
+
+instance_data instance_translation(vec3 const& p, float scale, vec3 const& color)
+{
+    instance_data instance;
+    instance.model = mat4::identity();
+    instance.model(0,0) = scale; instance.model(1,1) = scale; instance.model(2,2) = scale;
+    instance.model(0,3) = p.x; instance.model(1,3) = p.y; instance.model(2,3) = p.z;
+    instance.color = color;
+    return instance;
+}
+
+instance_data instance_transform(affine_rts const& transform, vec3 const& color)
+{
+    return {transform.matrix(), color};
+}
+
+mesh_drawable_instanced::mesh_drawable_instanced()
+    :drawable(), shader(0), vao(0), vbo_instance(0), number_instances(0), capacity(0)
+{}
+
+mesh_drawable_instanced::mesh_drawable_instanced(mesh_drawable const& drawable_arg, GLuint shader_arg)
+    :drawable(drawable_arg), shader(shader_arg), vao(0), vbo_instance(0), number_instances(0), capacity(0)
+{
+    glGenBuffers(1, &vbo_instance); opengl_check;
+
+    // Own vertex array: the per-vertex buffers of the mesh_drawable + the per-instance buffer
+    glGenVertexArrays(1, &vao); opengl_check;
+    glBindVertexArray(vao); opengl_check;
+
+    auto const attribute = [](GLuint location, GLuint vbo, GLint size) {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo); opengl_check;
+        glEnableVertexAttribArray(location); opengl_check;
+        glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, 0, nullptr); opengl_check;
+    };
+    attribute(0, drawable.vbo.at("position"), 3);
+    attribute(1, drawable.vbo.at("normal"), 3);
+    attribute(2, drawable.vbo.at("color"), 3);
+    attribute(3, drawable.vbo.at("uv"), 2);
+
+    // Per-instance attributes: 4 rows of the model matrix (location 4 to 7) and the color (location 8)
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instance); opengl_check;
+    GLsizei const stride = sizeof(instance_data);
+    for(GLuint k=0; k<4; ++k) {
+        glEnableVertexAttribArray(4+k); opengl_check;
+        glVertexAttribPointer(4+k, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(instance_data,model)+4*k*sizeof(float))); opengl_check;
+        glVertexAttribDivisor(4+k, 1); opengl_check;
+    }
+    glEnableVertexAttribArray(8); opengl_check;
+    glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(instance_data,color))); opengl_check;
+    glVertexAttribDivisor(8, 1); opengl_check;
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, drawable.vbo.at("index")); opengl_check;
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void mesh_drawable_instanced::update(std::vector<instance_data> const& instances)
+{
+    update(instances.data(), instances.size());
+}
+
+void mesh_drawable_instanced::update(instance_data const* instances, size_t N)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_instance); opengl_check;
+    if(N>capacity) {
+        // Grow geometrically to avoid reallocations when the number of particles increases slowly
+        capacity = std::max(N, 2*capacity);
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(capacity*sizeof(instance_data)), nullptr, GL_DYNAMIC_DRAW); opengl_check;
+    }
+    if(N>0) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, GLsizeiptr(N*sizeof(instance_data)), instances); opengl_check;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    number_instances = N;
+}
+
+void mesh_drawable_instanced::clear()
+{
+    glDeleteBuffers(1, &vbo_instance);
+    glDeleteVertexArrays(1, &vao);
+    vbo_instance = 0;
+    vao = 0;
+    number_instances = 0;
+    capacity = 0;
+}
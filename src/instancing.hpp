@@ -0,0 +1,69 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include <vector>
+
+// Per-instance data sent to the GPU
+struct instance_data
+{
+    vcl::mat4 model;  // model matrix of the instance
+    vcl::vec3 color;  // multiplied by the color of the mesh
+};
+
+// Instance placed by its translation (and uniform scaling) only
+instance_data instance_translation(vcl::vec3 const& p, float scale = 1.0f, vcl::vec3 const& color = {1,1,1});
+// Instance placed by a general transformation
+instance_data instance_transform(vcl::affine_rts const& transform, vcl::vec3 const& color = {1,1,1});
+
+/** Mesh displayed several times with a single instanced draw call
+*  - The geometry, shading and texture are shared with a mesh_drawable (its transform is ignored)
+*  - The per-instance data is sent by update(), once per frame for moving objects
+*  - The shader must read the per-instance attributes (see shader/mesh_instanced.vert.glsl) */
+struct mesh_drawable_instanced
+{
+    mesh_drawable_instanced();
+    mesh_drawable_instanced(vcl::mesh_drawable const& drawable, GLuint shader = default_shader);
+
+    // Send the per-instance data to the GPU (replaces the previous instances)
+    void update(std::vector<instance_data> const& instances);
+    void update(instance_data const* instances, size_t N);
+    void clear();
+
+    vcl::mesh_drawable drawable;
+    GLuint shader;
+    GLuint vao;
+    GLuint vbo_instance;
+    size_t number_instances;
+    size_t capacity; // number of instances allocated on the GPU
+
+    static GLuint default_shader;
+};
+
+
+template <typename SCENE>
+void draw(mesh_drawable_instanced const& instanced, SCENE const& scene)
+{
+    if(instanced.number_instances==0)
+        return;
+
+    vcl::mesh_drawable const& drawable = instanced.drawable;
+    assert_vcl(instanced.shader!=0, "Try to draw mesh_drawable_instanced without shader");
+    assert_vcl(drawable.texture!=0, "Try to draw mesh_drawable_instanced without texture");
+
+    // Setup shader and uniforms (once for all the instances)
+    glUseProgram(instanced.shader); opengl_check;
+    opengl_uniform(instanced.shader, scene);
+    vcl::opengl_uniform(instanced.shader, drawable.shading);
+
+    // Set texture
+    glActiveTexture(GL_TEXTURE0); opengl_check;
+    glBindTexture(GL_TEXTURE_2D, drawable.texture); opengl_check;
+    vcl::opengl_uniform(instanced.shader, "image_texture", 0); opengl_check;
+
+    // Single draw call for all the instances
+    glBindVertexArray(instanced.vao); opengl_check;
+    glDrawElementsInstanced(GL_TRIANGLES, GLsizei(drawable.number_triangles*3), GL_UNSIGNED_INT, nullptr, GLsizei(instanced.number_instances)); opengl_check;
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -1,5 +1,7 @@
 #include "interpolation.hpp"
 
+#include <algorithm>
+
 using namespace vcl;
 
 /** Compute the linear interpolation p(t) between p1 at time t1 and p2 at time t2*/
@@ -14,12 +16,63 @@ vcl::vec3 cardinal_spline_interpolation(float t, float t0, float t1, float t2, f
 * - Assume t \in [ intervals[0], intervals[N-1] [       */
 size_t find_index_of_interval(float t, vcl::buffer<float> const& intervals);
 
+/** Binary search of the interval, without checking the bounds */
+static size_t search_interval(float t, buffer<float> const& intervals);
+
+/** Segment used by the cardinal spline: it needs the key positions idx-1 and idx+2, so idx is clamped to [1,N-3]
+*  - t = key_times[1] is found on the segment 0 (see keyframe_track::find_segment): it is evaluated at the start of the segment 1 */
+static size_t spline_segment(size_t idx, size_t N);
+
+/** Cardinal spline interpolation on the segment idx */
+static vec3 interpolation_on_segment(float t, size_t idx, buffer<vec3> const& key_positions, buffer<float> const& key_times);
+
+/** Angle between the segment idx and the direction dir */
+static float direction_of_segment(size_t idx, buffer<vec3> const& key_positions, const vec3& dir);
 
-vec3 const interpolation(float t, buffer<vec3> key_positions, buffer<float> key_times)
+
+keyframe_track::keyframe_track(buffer<vec3> const& key_positions_arg, buffer<float> const& key_times_arg)
+    :key_positions(key_positions_arg), key_times(key_times_arg), cursor(0)
+{}
+
+size_t keyframe_track::find_segment(float t) const
 {
+    size_t const N = key_times.size();
+    assert_vcl(N>=2, "keyframe_track needs at least two key times");
+
+    // Current segment, or the next one when the time moves forward
+    for(size_t k=cursor; k<cursor+2 && k+1<N; ++k) {
+        if( (key_times[k]<t || k==0) && t<=key_times[k+1] ) {
+            cursor = k;
+            return k;
+        }
+    }
 
+    cursor = search_interval(t, key_times);
+    return cursor;
+}
+
+
+vec3 const interpolation(float t, buffer<vec3> const& key_positions, buffer<float> const& key_times)
+{
     // Find idx such that key_times[idx] < t < key_times[idx+1]
-    int const idx = find_index_of_interval(t, key_times);
+    size_t const idx = find_index_of_interval(t, key_times);
+    return interpolation_on_segment(t, idx, key_positions, key_times);
+}
+
+vec3 const interpolation(float t, keyframe_track const& track)
+{
+    return interpolation_on_segment(t, track.find_segment(t), track.key_positions, track.key_times);
+}
+
+static size_t spline_segment(size_t idx, size_t N)
+{
+    assert_vcl(N>=4, "The cardinal spline needs at least four key positions");
+    return std::min(std::max(idx, size_t(1)), N-3);
+}
+
+static vec3 interpolation_on_segment(float t, size_t segment, buffer<vec3> const& key_positions, buffer<float> const& key_times)
+{
+    size_t const idx = spline_segment(segment, key_times.size());
 
     // Parameters used to compute the linear interpolation
     float const t1 = key_times[idx]; // = t_i
@@ -43,8 +96,17 @@ vec3 const interpolation(float t, buffer<vec3> key_positions, buffer<float> key_
 float direction(float t, buffer<vec3> const& key_positions, buffer<float> const& key_times, const vec3& dir){
 
     // Find idx such that key_times[idx] < t < key_times[idx+1]
-    int const idx = find_index_of_interval(t, key_times);
+    size_t const idx = find_index_of_interval(t, key_times);
+    return direction_of_segment(idx, key_positions, dir);
+}
+
+float direction(float t, keyframe_track const& track, const vec3& dir)
+{
+    return direction_of_segment(track.find_segment(t), track.key_positions, dir);
+}
 
+static float direction_of_segment(size_t idx, buffer<vec3> const& key_positions, const vec3& dir)
+{
     vec3 const& p1 = key_positions[idx]; // = p_i
     vec3 const& p2 = key_positions[idx+1]; // = p_{i+1}
 
@@ -86,8 +148,93 @@ size_t find_index_of_interval(float t, buffer<float> const& intervals)
     }
 
 
-    size_t k=0;
-    while( intervals[k+1]<t )
-        ++k;
-    return k;
+    return search_interval(t, intervals);
+}
+
+static size_t search_interval(float t, buffer<float> const& intervals)
+{
+    // First value >= t, the interval starts at the previous one
+    size_t const N = intervals.size();
+    size_t const k = std::lower_bound(intervals.begin(), intervals.end(), t) - intervals.begin();
+    return std::min(k>0 ? k-1 : 0, N-2);
+}
+
+
+
+void spline_batch::resize(size_t N)
+{
+    for(int i=0; i<4; ++i) {
+        w[i].resize(N);
+        px[i].resize(N); py[i].resize(N); pz[i].resize(N);
+    }
+}
+
+void spline_batch::set_point(size_t k, float t, size_t segment, keyframe_track const& track)
+{
+    buffer<float> const& key_times = track.key_times;
+    buffer<vec3> const& key_positions = track.key_positions;
+    size_t const idx = spline_segment(segment, key_times.size());
+
+    float const t0 = key_times[idx-1], t1 = key_times[idx], t2 = key_times[idx+1], t3 = key_times[idx+2];
+    float const K = 0.5f;
+
+    // Hermite basis, same expression as cardinal_spline_interpolation
+    float const s = (t-t1)/(t2-t1);
+    float const h00 = 2*s*s*s - 3*s*s + 1;
+    float const h10 = s*s*s - 2*s*s + s;
+    float const h01 = 3*s*s - 2*s*s*s;
+    float const h11 = s*s*s - s*s;
+
+    // Tangents d1 = a1*(p2-p0), d2 = a2*(p3-p1) expanded on the control points
+    float const a1 = 2*K/(t2-t0);
+    float const a2 = 2*K/(t3-t1);
+    w[0][k] = -h10*a1;
+    w[1][k] = h00 - h11*a2;
+    w[2][k] = h01 + h10*a1;
+    w[3][k] = h11*a2;
+
+    for(int i=0; i<4; ++i) {
+        vec3 const& p = key_positions[idx-1+i];
+        px[i][k] = p.x; py[i][k] = p.y; pz[i][k] = p.z;
+    }
+}
+
+void spline_batch::combine(size_t N, vec3* out) const
+{
+    static_assert(sizeof(vec3)==3*sizeof(float), "spline_batch writes the vec3 as packed floats");
+    if(N==0)
+        return;
+
+    float const* __restrict w0 = w[0].data(); float const* __restrict w1 = w[1].data();
+    float const* __restrict w2 = w[2].data(); float const* __restrict w3 = w[3].data();
+
+    // One loop per coordinate over contiguous arrays
+    float const* const p[3][4] = {
+        {px[0].data(), px[1].data(), px[2].data(), px[3].data()},
+        {py[0].data(), py[1].data(), py[2].data(), py[3].data()},
+        {pz[0].data(), pz[1].data(), pz[2].data(), pz[3].data()} };
+    float* const o = &out[0].x;
+    for(int c=0; c<3; ++c) {
+        float const* __restrict q0 = p[c][0]; float const* __restrict q1 = p[c][1];
+        float const* __restrict q2 = p[c][2]; float const* __restrict q3 = p[c][3];
+        for(size_t k=0; k<N; ++k)
+            o[3*k+c] = w0[k]*q0[k] + w1[k]*q1[k] + w2[k]*q2[k] + w3[k]*q3[k];
+    }
+}
+
+void spline_batch::evaluate(float t, std::vector<keyframe_track> const& tracks, vec3* out)
+{
+    size_t const N = tracks.size();
+    resize(N);
+    for(size_t k=0; k<N; ++k)
+        set_point(k, t, tracks[k].find_segment(t), tracks[k]);
+    combine(N, out);
+}
+
+void spline_batch::evaluate(keyframe_track const& track, float const* times, size_t N, vec3* out)
+{
+    resize(N);
+    for(size_t k=0; k<N; ++k)
+        set_point(k, times[k], track.find_segment(times[k]), track); // the cursor follows increasing times
+    combine(N, out);
 }
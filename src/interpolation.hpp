@@ -4,7 +4,46 @@
 #include "vcl/vcl.hpp"
 #include <math.h>
 #include <cstdlib>
+#include <vector>
+
+/** Key positions and key times of a trajectory, stored by reference (no copy)
+*  - The segment found by the previous lookup is kept as a cursor:
+*    O(1) lookup when t increases monotonically, binary search otherwise */
+struct keyframe_track
+{
+    keyframe_track(vcl::buffer<vcl::vec3> const& key_positions, vcl::buffer<float> const& key_times);
+
+    // Index k such that key_times[k] < t <= key_times[k+1]
+    size_t find_segment(float t) const;
+
+    vcl::buffer<vcl::vec3> const& key_positions;
+    vcl::buffer<float> const& key_times;
+    mutable size_t cursor; // segment of the last lookup
+};
 
 // Compute the interpolated position p(t) given a time t and the set of key_positions and key_frame
-vcl::vec3 const interpolation(float t, vcl::buffer<vcl::vec3> key_positions, vcl::buffer<float> key_times);
+vcl::vec3 const interpolation(float t, vcl::buffer<vcl::vec3> const& key_positions, vcl::buffer<float> const& key_times);
+vcl::vec3 const interpolation(float t, keyframe_track const& track);
 float direction(float t, vcl::buffer<vcl::vec3> const& key_positions, vcl::buffer<float> const& key_times, const vcl::vec3& dir);
+float direction(float t, keyframe_track const& track, const vcl::vec3& dir);
+
+
+/** Evaluation of many cardinal spline points at once
+*  - The spline of a segment is expressed as 4 weights applied to the control points p_{i-1},p_i,p_{i+1},p_{i+2},
+*    the weights are computed once per point then combined in loops over contiguous arrays (vectorized over the points)
+*  - The internal buffers are reused from one call to the next */
+struct spline_batch
+{
+    // out[k] = interpolation(t, tracks[k]): N trajectories at the same time
+    void evaluate(float t, std::vector<keyframe_track> const& tracks, vcl::vec3* out);
+    // out[k] = interpolation(times[k], track): one trajectory at N times
+    void evaluate(keyframe_track const& track, float const* times, size_t N, vcl::vec3* out);
+
+private:
+    void resize(size_t N);
+    void set_point(size_t k, float t, size_t idx, keyframe_track const& track);
+    void combine(size_t N, vcl::vec3* out) const;
+
+    std::vector<float> w[4];                  // weights of the 4 control points
+    std::vector<float> px[4], py[4], pz[4];   // coordinates of the 4 control points
+};
@@ -0,0 +1,151 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+
+// Job system and queue of the current thread when it is one of the workers
+static thread_local job_system const* worker_owner = nullptr;
+static thread_local size_t worker_queue = 0;
+
+static std::atomic<job_system*> global_jobs{nullptr};
+
+job_system::job_system(unsigned int N_thread)
+{
+    if(N_thread==0)
+        N_thread = std::max(1u, std::thread::hardware_concurrency());
+    for(unsigned int k=0; k<N_thread; ++k)
+        queues.emplace_back(new job_queue);
+    workers.reserve(N_thread-1);
+    for(size_t k=1; k<N_thread; ++k)
+        workers.emplace_back([this,k](){ run(k); });
+}
+
+job_system::~job_system()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stop = true;
+    }
+    sleep_condition.notify_all();
+    for(std::thread& worker : workers)
+        worker.join();
+}
+
+void job_system::submit(job_counter& counter, std::function<void()> task)
+{
+    job j;
+    j.task = std::move(task);
+    j.counter = &counter;
+    push(std::move(j));
+}
+
+void job_system::push(job&& j)
+{
+    j.counter->count.fetch_add(1);
+    {
+        job_queue& queue = *queues[current_queue()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(j));
+    }
+    queued.fetch_add(1);
+    if(workers.empty())
+        return;
+    {
+        // Taking the lock orders the push before the test of a worker going to sleep
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    sleep_condition.notify_one();
+}
+
+bool job_system::take(size_t queue_index, job& j)
+{
+    if(queued.load()==0)
+        return false;
+
+    // Most recent job of the own queue
+    {
+        job_queue& queue = *queues[queue_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(!queue.jobs.empty()) {
+            j = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // Oldest job of another queue
+    for(size_t k=1; k<queues.size(); ++k) {
+        job_queue& queue = *queues[(queue_index+k)%queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(!queue.jobs.empty()) {
+            j = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void job_system::execute(job& j)
+{
+    if(j.run_range)
+        j.run_range(j.f, j.begin, j.end);
+    else
+        j.task();
+    j.task = nullptr;
+    j.counter->count.fetch_sub(1); // last access to the job: the waiting thread may release the counter right after
+}
+
+void job_system::wait(job_counter& counter)
+{
+    size_t const queue = current_queue();
+    job j;
+    while(counter.count.load()>0) {
+        if(take(queue, j))
+            execute(j);
+        else
+            std::this_thread::yield(); // the remaining jobs of the group run on other threads
+    }
+}
+
+size_t job_system::size() const
+{
+    return queues.size();
+}
+
+size_t job_system::current_queue() const
+{
+    return worker_owner==this ? worker_queue : 0;
+}
+
+void job_system::run(size_t queue)
+{
+    worker_owner = this;
+    worker_queue = queue;
+    job j;
+    for(;;) {
+        if(take(queue, j)) {
+            execute(j);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleep_condition.wait(lock, [this](){ return stop || queued.load()>0; });
+        if(stop)
+            return;
+    }
+}
+
+job_system& job_system::global()
+{
+    job_system* jobs = global_jobs.load();
+    if(jobs!=nullptr)
+        return *jobs;
+    static job_system hardware_jobs;
+    return hardware_jobs;
+}
+
+void job_system::set_global(job_system* jobs)
+{
+    global_jobs.store(jobs);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of submitted jobs of a group that are not finished yet
+struct job_counter
+{
+    std::atomic<size_t> count{0};
+};
+
+/** Work-stealing job system for the short tasks of a frame (particle chunks, batches of birds, culling, terrain rows ...)
+*  - One deque of jobs per thread: a thread pushes and takes its own jobs at the back (the most recent, still in cache),
+*     an idle thread steals at the front of the other deques (the oldest jobs, usually the largest ranges)
+*  - Each job decrements the counter of its group when it is finished. wait(counter) runs the pending jobs instead of
+*     blocking until the counter drops to 0: a job can submit jobs and wait for them
+*  - The threads outside the job system (ex. the main thread) share the deque 0 and take part in the work while they wait
+*  - Unlike thread_pool, nothing here is meant to block on I/O or to span several frames */
+struct job_system
+{
+    // N_thread: number of threads running jobs including the waiting thread (0: hardware threads)
+    explicit job_system(unsigned int N_thread = 0);
+    ~job_system();
+    job_system(job_system const&) = delete;
+    job_system& operator=(job_system const&) = delete;
+
+    // Run task() on any thread
+    void submit(job_counter& counter, std::function<void()> task);
+    // Run f(begin,end) on any thread without allocation: f is stored by reference and must outlive wait(counter)
+    template <typename F> void submit(job_counter& counter, size_t begin, size_t end, F const& f);
+    // Run jobs until every job of the group is finished
+    void wait(job_counter& counter);
+
+    size_t size() const; // number of threads running jobs, including the waiting thread
+
+    // Job system used by parallel_for: the hardware threads, unless replaced by set_global (ex. by a benchmark)
+    static job_system& global();
+    static void set_global(job_system* jobs);
+
+private:
+    struct job
+    {
+        void (*run_range)(void const* f, size_t begin, size_t end) = nullptr;
+        void const* f = nullptr;
+        size_t begin = 0, end = 0;
+        std::function<void()> task; // used when run_range is null
+        job_counter* counter = nullptr;
+    };
+    struct job_queue
+    {
+        std::mutex mutex;
+        std::deque<job> jobs;
+    };
+
+    void push(job&& j);
+    bool take(size_t queue, job& j);
+    void execute(job& j);
+    size_t current_queue() const;
+    void run(size_t queue);
+
+    std::vector<std::unique_ptr<job_queue>> queues; // queue 0: threads outside the job system, k>0: worker k
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued{0};  // jobs waiting in the queues
+    std::mutex sleep_mutex;         // idle workers sleep until a job is pushed
+    std::condition_variable sleep_condition;
+    bool stop = false;
+};
+
+
+template <typename F>
+void job_system::submit(job_counter& counter, size_t begin, size_t end, F const& f)
+{
+    job j;
+    j.run_range = [](void const* f_arg, size_t b, size_t e) { (*static_cast<F const*>(f_arg))(b, e); };
+    j.f = &f;
+    j.begin = begin;
+    j.end = end;
+    j.counter = &counter;
+    push(std::move(j));
+}
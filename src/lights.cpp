@@ -0,0 +1,82 @@
+#include "lights.hpp"
+
+#include <cmath>
+#include <limits>
+
+using namespace vcl;
+
+float spotlight_radius(float falloff)
+{
+    if(falloff<=0)
+        return std::numeric_limits<float>::infinity();
+    return std::sqrt(std::log(256.0f)/falloff);
+}
+
+size_t light_registry::add_static(vec3 const& p, vec3 const& c)
+{
+    position.insert(position.begin()+static_count, p);
+    color.insert(color.begin()+static_count, c);
+    radius.insert(radius.begin()+static_count, spotlight_radius(falloff));
+    version++;
+    static_version++;
+    return static_count++;
+}
+
+size_t light_registry::add_dynamic(vec3 const& p, vec3 const& c)
+{
+    position.push_back(p);
+    color.push_back(c);
+    radius.push_back(spotlight_radius(falloff));
+    version++;
+    return dynamic_count()-1;
+}
+
+void light_registry::set_dynamic(size_t k, vec3 const& p, vec3 const& c)
+{
+    size_t const i = static_count+k;
+    assert_vcl(i<size(), "Incorrect index of dynamic light");
+    vec3 const& p0 = position[i];
+    vec3 const& c0 = color[i];
+    if(p0.x==p.x && p0.y==p.y && p0.z==p.z && c0.x==c.x && c0.y==c.y && c0.z==c.z)
+        return;
+    position[i] = p;
+    color[i] = c;
+    version++;
+}
+
+void light_registry::set_falloff(float f)
+{
+    if(f==falloff)
+        return;
+    falloff = f;
+    float const r = spotlight_radius(falloff);
+    for(float& radius_k : radius)
+        radius_k = r;
+    version++;
+    static_version++;
+}
+
+void light_registry::clear()
+{
+    position.clear();
+    color.clear();
+    radius.clear();
+    static_count = 0;
+    version++;
+    static_version++;
+}
+
+size_t light_registry::size() const
+{
+    return position.size();
+}
+
+size_t light_registry::dynamic_count() const
+{
+    return size()-static_count;
+}
+
+bounding_sphere light_registry::bounds(size_t k) const
+{
+    return {position[k], radius[k]};
+}
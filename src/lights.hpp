@@ -0,0 +1,39 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include "culling.hpp"
+
+#include <vector>
+
+// Distance at which the attenuation exp(-falloff*d^2) of a spotlight drops below 1/256 (infinite when falloff<=0)
+float spotlight_radius(float falloff);
+
+/** Spotlights of the scene
+*  - Static lights (ex. the street lamps) are added once, dynamic lights can be moved on every frame with set_dynamic()
+*  - Lights are stored static first, then dynamic: position[k], color[k] and radius[k] for k \in [0,size()[
+*  - Each effective change increments version (and static_version for the static lights): the users only rebuild
+*     and send their data when it changed (see light_clusters)
+*  - The radius of a light is the distance where its attenuation exp(-falloff*d^2) drops below 1/256 (see spotlight_radius) */
+struct light_registry
+{
+    // Return the index of the light among the static (resp. dynamic) lights
+    size_t add_static(vcl::vec3 const& p, vcl::vec3 const& c);
+    size_t add_dynamic(vcl::vec3 const& p, vcl::vec3 const& c);
+    // Nothing changes when the light is already at this position with this color
+    void set_dynamic(size_t k, vcl::vec3 const& p, vcl::vec3 const& c);
+    void set_falloff(float falloff);
+    void clear();
+
+    size_t size() const;
+    size_t dynamic_count() const;
+    bounding_sphere bounds(size_t k) const; // sphere of influence of the light k
+
+    std::vector<vcl::vec3> position;
+    std::vector<vcl::vec3> color;
+    std::vector<float> radius;
+    size_t static_count = 0;
+    float falloff = 0.5f;
+
+    size_t version = 1;
+    size_t static_version = 1;
+};
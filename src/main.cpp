@@ -1,10 +1,26 @@
 #include "vcl/vcl.hpp"
 #include <iostream>
 #include "terrain.hpp"
+#include "heightfield.hpp"
 #include "birds.hpp"
 #include "tree.hpp"
 #include "interpolation.hpp"
-#include <list>
+#include "particles.hpp"
+#include "simulation.hpp"
+#include "instancing.hpp"
+#include "benchmark.hpp"
+#include "static_batch.hpp"
+#include "flock.hpp"
+#include "culling.hpp"
+#include "terrain_chunks.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_binary.hpp"
+#include "asset_manager.hpp"
+#include "shader_program.hpp"
+#include "scene_uniforms.hpp"
+#include "lights.hpp"
+#include "job_system.hpp"
+#include "parallel.hpp"
 
 
 using namespace vcl;
@@ -23,6 +39,8 @@ struct gui_parameters {
         int trajectory_storage = 100;
         bool display_surface = true;
         bool display_wireframe = false;
+        int flock_size = 100;
+        float snow_rate = 60.0f;
 };
 
 struct user_interaction_parameters {
@@ -32,35 +50,29 @@ struct user_interaction_parameters {
         gui_parameters gui;
         bool cursor_on_gui;
         picking_structure picking;
+        frame_statistics statistics;
 };
 user_interaction_parameters user;
 
 
-// Structure of a particle
-struct particle_structure
-{
-    vcl::vec3 p; // Position
-    vcl::vec3 v; // Speed
-};
-
-
-
 struct scene_environment
 {
         camera_around_center camera;
         mat4 projection;
         vec3 light;
-        // Consider a set of spotlight defined by their position and color
-        std::array<vec3,5> spotlight_position;
-        std::array<vec3,5> spotlight_color;
+        // The spotlights themselves are in scene_lights
         float spotlight_falloff = 0.5;
         float fog_falloff = false;
         float t;
+        float field_of_view = 50.0f*pi/180.0f;
+        int window_height = 1;
 };
 scene_environment scene;
 
 buffer<vec3> key_positions;
 buffer<float> key_times;
+keyframe_track bird_track(key_positions, key_times); // lookup of the current segment of the bird trajectory
+keyframe_track trajectory_track(key_positions, key_times); // same keys, own cursor for the samples of the displayed trajectory
 timer_interval timer;
 
 void mouse_move_callback(GLFWwindow* window, double xpos, double ypos);
@@ -71,11 +83,16 @@ void display_scene();
 void display_interface();
 
 mesh terrain_visual;
+heightfield terrain_field; // cached samples of the terrain used by the particles and the placement of objects
 
 mesh_drawable billboard_grass;
 mesh_drawable terrain;
-mesh_drawable street_lamp;
-mesh_drawable tore;
+asset_manager assets; // meshes and textures loaded once per path, decoded on worker threads
+terrain_chunks terrain_streaming; // terrain around the central one, generated by chunks when the camera moves
+shader_program_registry shaders; // uniform locations of the programs, per-frame uniforms sent once per program
+scene_uniform_buffer scene_uniforms; // per-frame state of the scene, shared by the programs declaring the block "scene_data"
+light_registry scene_lights; // static (street lamps) and dynamic spotlights
+light_clusters spotlight_clusters; // lists of the spotlights reaching each cluster of the view frustum
 mesh_drawable fontaine;
 std::vector<vcl::vec3> tree_position1;
 std::vector<vcl::vec3> tree_position2;
@@ -88,13 +105,25 @@ mesh_drawable sphere_current;    // sphere used to display the interpolated valu
 mesh_drawable sphere_keyframe;   // sphere used to display the key positions
 curve_drawable polygon_keyframe; // Display the segment between key positions
 trajectory_drawable trajectory;  // Temporary storage and display of the interpolated trajectory
+spline_batch trajectory_sampling; // evaluation of the samples of the displayed trajectory
+std::vector<float> trajectory_times;
+std::vector<vec3> trajectory_samples;
 
-hierarchy_mesh_drawable hierarchy1;//Oiseau
+bird_lod birds_lod; // bird hierarchy evaluated and drawn for all the birds at once, with levels of detail
+flock birds; // Flock following the leading bird
+std::vector<bird_pose> bird_poses; // the leading bird then the flock
 
-std::list<particle_structure> particles; // Storage of all currently active particles
-std::list<particle_structure> neiges; // Storage of all currently active particles
+scene_simulation simulation;       // rain drops, snow and bird key positions, fixed time step on a worker thread
 mesh_drawable sphere;
 mesh_drawable snow;
+mesh_drawable_instanced sphere_instanced; // rain drops drawn with a single draw call
+mesh_drawable_instanced snow_instanced;   // snowflakes drawn with a single draw call
+mesh_drawable_instanced grass_instanced;  // grass billboards (instances of the visible tufts)
+std::vector<instance_data> drop_instances;  // per-frame storage of the instances of the particles in the view frustum
+std::vector<instance_data> flake_instances;
+std::vector<size_t> flake_chunk_visible;    // number of visible flakes of each chunk of flake_instances
+float const drop_radius = 0.01f;            // rayon de la goutte
+float const flake_radius = 0.02f;           // rayon du flocon
 
 mesh_drawable moon;
 
@@ -105,6 +134,7 @@ mesh_drawable ground;
 
 mesh_drawable grid;
 
+// Materials of the trees of the forest: the placed instances are merged in a single mesh per material and per tile
 mesh_drawable trunk3;
 mesh_drawable trunk2;
 mesh_drawable branches;
@@ -112,13 +142,61 @@ mesh_drawable foliage2;
 
 mesh_drawable statue;
 
-int main(int, char* argv[])
+// Motionless objects culled against the view frustum: the static drawables then the grass tufts
+std::vector<mesh_drawable> static_objects;    // tiles of the forest, street lamps, fountain and statue
+std::vector<bounding_sphere> culling_spheres;  // bounding sphere of each object
+std::vector<instance_data> grass_tufts;        // two billboards per grass tuft
+bvh scene_bvh;
+std::vector<uint32_t> visible_objects;
+std::vector<instance_data> grass_visible;
+
+void add_static_object(mesh_drawable const& drawable, bounding_sphere const& sphere);
+void add_static_tiles(static_batch_tiles const& batch, mesh_drawable const& material);
+
+int main(int argc, char* argv[])
 {
 	std::cout << "Run " << argv[0] << std::endl;
+        benchmark_parameters const benchmark = parse_benchmark_arguments(argc, argv);
+        if(convert_obj_arguments(argc, argv))
+                return 0;
+        if(benchmark.mesh_loading) {
+                benchmark_mesh_loading(std::cout);
+                return 0;
+        }
+        if(benchmark.culling_objects>0) {
+                // The culling benchmark runs on the CPU only: no window is needed
+                benchmark_culling(size_t(benchmark.culling_objects), std::cout);
+                return 0;
+        }
+        if(benchmark.noise_resolution>0) {
+                benchmark_noise(size_t(benchmark.noise_resolution), std::cout);
+                return 0;
+        }
+        if(benchmark.terrain_resolution>0) {
+                benchmark_terrain(unsigned(benchmark.terrain_resolution), std::cout);
+                return 0;
+        }
+        if(benchmark.lights>0) {
+                benchmark_lights(size_t(benchmark.lights), std::cout);
+                return 0;
+        }
+        if(benchmark.snowflakes>0) {
+                benchmark_snow(size_t(benchmark.snowflakes), std::cout);
+                return 0;
+        }
+        if(benchmark.job_frames>0) {
+                benchmark_jobs(size_t(benchmark.job_frames), std::cout);
+                return 0;
+        }
 
         int const width = 3280, height = 1524;
 	GLFWwindow* window = create_window(width, height);
 	window_size_callback(window, width, height);
+        if(benchmark.frames>0) {
+                // Hidden window without vsync: can run headless (ex. Xvfb + Mesa llvmpipe)
+                glfwHideWindow(window);
+                glfwSwapInterval(0);
+        }
 	std::cout << opengl_info_display() << std::endl;;
 
 	imgui_init(window);
@@ -126,13 +204,25 @@ int main(int, char* argv[])
 	glfwSetWindowSizeCallback(window, window_size_callback);
 	
 	std::cout<<"Initialize data ..."<<std::endl;
+	std::chrono::steady_clock::time_point const initialization_start = std::chrono::steady_clock::now();
 	initialize_data();
+	std::cout<<"Initialization: "<<1000*std::chrono::duration<double>(std::chrono::steady_clock::now()-initialization_start).count()<<" ms"
+	         <<" (meshes: "<<mesh_loading.binary_files<<" binary files in "<<1000*mesh_loading.binary_time<<" ms, "
+	         <<mesh_loading.obj_files<<" OBJ files in "<<1000*mesh_loading.obj_time<<" ms)"<<std::endl;
+        if(benchmark.frames>0)
+                assets.wait(); // the measured frames use the final textures
+        simulation.start();
 
 	std::cout<<"Start animation loop ..."<<std::endl;
 	user.fps_record.start();
 	glEnable(GL_DEPTH_TEST);
 	while (!glfwWindowShouldClose(window))
 	{
+                if(benchmark.frames>0 && user.statistics.frames>=size_t(benchmark.frames))
+                        break;
+                user.statistics.start_frame();
+                shaders.start_frame();
+                assets.poll(); // textures decoded since the last frame
                 //scene.light = scene.camera.position();
 		user.fps_record.update();
 		
@@ -149,16 +239,18 @@ int main(int, char* argv[])
                 //user.cursor_on_gui = ImGui::IsAnyWindowFocused();
                 user.cursor_on_gui = ImGui::GetIO().WantCaptureMouse;
 
-		if(user.gui.display_frame) draw(user.global_frame, scene);
-
 		display_interface();
                 display_scene();
 
 		ImGui::End();
 		imgui_render_frame(window);
+                user.statistics.end_frame();
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
+        if(benchmark.frames>0)
+                user.statistics.print(std::cout);
+        simulation.stop();
 
 	imgui_cleanup();
 	glfwDestroyWindow(window);
@@ -169,8 +261,23 @@ int main(int, char* argv[])
 
 void initialize_data()
 {
+        // Every program declaring the block "scene_data" reads the per-frame state from the same buffer
+        scene_uniforms.initialize();
+        shaders.bind_block("scene_data", scene_uniform_buffer::binding);
+        spotlight_clusters.initialize();
+        shaders.bind_sampler("cluster_grid", light_clusters::unit_grid);
+        shaders.bind_sampler("cluster_lights", light_clusters::unit_indices);
+        shaders.bind_sampler("light_data", light_clusters::unit_lights);
+
         // Read the specific shader and generate a uniform grid
-        GLuint const shader_deform = opengl_create_shader_program( read_text_file("shader/shader_deform.vert.glsl"), read_text_file("shader/shader_deform.frag.glsl"));
+        GLuint const shader_deform = shaders.create( read_shader_file("shader/shader_deform.vert.glsl"), read_shader_file("shader/shader_deform.frag.glsl"));
+
+        // The assets are decoded in parallel while the rest of the scene is initialized
+        //  The textures stay white until they are loaded, but the meshes deliberately block the startup at their first use (assets.mesh):
+        //  the static batches, the culling spheres and the bounding volume hierarchy are built once from them
+        assets.initialize();
+        for(std::string const path : {"assets/statue.obj", "assets/trunk.obj", "assets/branches.obj", "assets/foliage.obj"})
+                assets.request_mesh(path);
 
         GLuint const texture_white = opengl_texture_to_gpu(image_raw{1,1,image_color_type::rgba,{255,255,255,255}});
         mesh_drawable::default_texture = texture_white;
@@ -179,31 +286,25 @@ void initialize_data()
         grid.transform.translate = {-1.5,2.0f, 0.7};
         grid.shader = shader_deform;
         grid.shading.color = {0.0f, 0.94f, 1.0f};
-        grid.texture = opengl_texture_to_gpu(image_load_png("assets/water.png"));
+        grid.texture = assets.texture("assets/water.png");
 
-        GLuint const shader_mesh = opengl_create_shader_program(read_text_file("shader/mesh_lights.vert.glsl"),read_text_file("shader/mesh_lights.frag.glsl"));
+        GLuint const shader_mesh = shaders.create(read_shader_file("shader/mesh_lights.vert.glsl"),read_shader_file("shader/mesh_lights.frag.glsl"));
 
-        /** Load a shader that makes fully transparent fragments when alpha-channel of the texture is small */
-        GLuint const shader_with_transparency = opengl_create_shader_program( read_text_file("shader/transparency.vert.glsl"), read_text_file("shader/transparency.frag.glsl"));
+        /** Shader reading the model matrix and color of each instance from vertex attributes */
+        mesh_drawable_instanced::default_shader = shaders.create(read_shader_file("shader/mesh_instanced.vert.glsl"),read_shader_file("shader/mesh_lights.frag.glsl"));
+        GLuint const shader_instanced_transparency = shaders.create(read_shader_file("shader/mesh_instanced.vert.glsl"),read_shader_file("shader/transparency.frag.glsl"));
 
-        foliage2 = mesh_drawable( mesh_load_file_obj("assets/foliage.obj") );
-        foliage2.texture = opengl_texture_to_gpu( image_load_png("assets/pine.png") );
-        foliage2.shader = shader_with_transparency; // set the shader handling transparency for the foliage
-        foliage2.shading.phong = {0.4f, 0.6f, 0, 1};     // remove specular effect for the billboard
+        /** Load a shader that makes fully transparent fragments when alpha-channel of the texture is small */
+        GLuint const shader_with_transparency = shaders.create( read_shader_file("shader/transparency.vert.glsl"), read_shader_file("shader/transparency.frag.glsl"));
 
         mesh_drawable::default_shader = shader_mesh;
 
-        statue = mesh_drawable( mesh_load_file_obj("assets/statue.obj"));
+        mesh const& statue_mesh = assets.mesh("assets/statue.obj");
+        statue = mesh_drawable( statue_mesh );
         statue.transform.scale = (0.01,0.01,0.01);
-        statue.texture = opengl_texture_to_gpu( image_load_png("assets/statue.png") );
-
-
-        trunk2 = mesh_drawable( mesh_load_file_obj("assets/trunk.obj"));
-        trunk3 = mesh_drawable( mesh_load_file_obj("assets/trunk.obj"));
-        trunk3.texture = opengl_texture_to_gpu( image_load_png("assets/trunk.png") );
-
-        branches = mesh_drawable( mesh_load_file_obj("assets/branches.obj"));
-        branches.shading.color = {0.45f, 0.41f, 0.34f}; // branches do not have textures
+        statue.transform.translate = {6,-1.0f, 1.3};
+        statue.transform.rotate = rotation(vec3{0,0,-1}, 3.14f/2);
+        statue.texture = assets.texture("assets/statue.png");
 
 	user.global_frame = mesh_drawable(mesh_primitive_frame());
 	user.gui.display_frame = false;
@@ -214,9 +315,11 @@ void initialize_data()
     /** Terrain  **/
     /** *************************************************************  **/
 
-    // Create visual terrain surface
-        terrain_visual = create_terrain();
+    // Create visual terrain surface (read from the cache when the parameters did not change since the last run)
+        unsigned int const terrain_resolution = 100;
+        terrain_visual = cached_mesh("terrain", cache_key().add(terrain_revision).add(parameters).add(terrain_resolution), [&](){ return create_terrain(terrain_resolution); });
         terrain = mesh_drawable(terrain_visual);
+        terrain_field.build_cached(parameters);
 
     terrain.shading.color = {1.0f, 1.0f, 1.0f};
     terrain.shading.phong.specular = 0.0f; // non-specular terrain material
@@ -225,37 +328,121 @@ void initialize_data()
     /** Motionless Objects  **/
     /** *************************************************************  **/
 
-    billboard_grass = mesh_drawable(mesh_primitive_quadrangle({-0.5,0,0},{0.5,0,0},{0.5,0,1},{-0.5,0,1}));
+    // The small vegetation sprites are packed in a single texture: their texture coordinates are remapped to their region
+    texture_atlas vegetation_atlas;
+    vegetation_atlas.layout({"assets/grass.png", "assets/redflowers.png", "assets/squirrel.png", "assets/pine.png"});
+    GLuint const vegetation_texture = assets.atlas_texture("vegetation", vegetation_atlas);
+
+    mesh billboard_grass_mesh = mesh_primitive_quadrangle({-0.5,0,0},{0.5,0,0},{0.5,0,1},{-0.5,0,1});
+    remap_uv(billboard_grass_mesh, vegetation_atlas.region("assets/grass.png"));
+    billboard_grass = mesh_drawable(billboard_grass_mesh);
     billboard_grass.transform.scale = 0.4f;
     billboard_grass.transform.translate = {0.5f, 0.5f, 0.0f};
-    billboard_grass.texture = opengl_texture_to_gpu(image_load_png("assets/grass.png"));
-
-    street_lamp = mesh_drawable(create_street_lamp());
-    mesh torus = mesh_primitive_torus(0.08f, 0.02f, {0,0,0}, {0,0,1}, 20,20);
-    torus.color.fill({0,0,0});
-    tore = mesh_drawable(torus);
+    billboard_grass.texture = vegetation_texture;
 
-    fontaine = mesh_drawable(create_fontaine());
-    fontaine.texture = opengl_texture_to_gpu(image_load_png("assets/rock.png"));
+    mesh const fontaine_mesh = cached_mesh("fontaine", cache_key().add(fontaine_revision), create_fontaine);
+    fontaine = mesh_drawable(fontaine_mesh);
+    fontaine.transform.translate = {-2.5,1.0f, 0.2};
+    fontaine.texture = assets.texture("assets/rock.png");
 
     moon = mesh_drawable(mesh_primitive_sphere(1.0f));
     moon.shading.color = {1.0f,1.0f,1.0f};
     moon.transform.translate = {15,40,15};
-    moon.texture = opengl_texture_to_gpu(image_load_png("assets/moon.png"));
+    moon.texture = assets.texture("assets/moon.png");
     moon.shading.phong = {0.4f, 0.6f, 0, 1};
 
-    image_raw const im = image_load_png("assets/texture_grass.png");
-    GLuint const texture_image_id = opengl_texture_to_gpu(im,
+    GLuint const texture_image_id = assets.texture("assets/texture_grass.png",
             GL_MIRRORED_REPEAT /**GL_TEXTURE_WRAP_S*/,
             GL_MIRRORED_REPEAT /**GL_TEXTURE_WRAP_T*/);
     terrain.texture = texture_image_id;
+    terrain_streaming.initialize(terrain, parameters);
 
-    tree_position1 = generate_positions_on_terrain(6);
-    tree_position2 = generate_positions_on_terrain(9);
-    tree_position3 = generate_positions_on_terrain(7);
-    tree_position4 = generate_positions_on_terrain(13);
-    grass_position = generate_positions_on_terrain(30);
-    street_lamp_position = generate_positions_on_terrain(2);
+    tree_position1 = generate_positions_on_terrain(6, terrain_field);
+    tree_position2 = generate_positions_on_terrain(9, terrain_field);
+    tree_position3 = generate_positions_on_terrain(7, terrain_field);
+    tree_position4 = generate_positions_on_terrain(13, terrain_field);
+    grass_position = generate_positions_on_terrain(30, terrain_field);
+    street_lamp_position = generate_positions_on_terrain(2, terrain_field);
+
+    /** *************************************************************  **/
+    /** Static batches: trees and street lamps  **/
+    /** *************************************************************  **/
+
+    // Each tree is baked once in the merged mesh of each of its materials,
+    //  split on 3 x 3 tiles of the terrain so that the tiles out of view are culled
+    //  Waits for the tree meshes: their loading overlapped the initialization above
+    mesh const& trunk_mesh = assets.mesh("assets/trunk.obj");
+    mesh const& branches_mesh = assets.mesh("assets/branches.obj");
+    mesh foliage_mesh = assets.mesh("assets/foliage.obj");
+    bool const foliage_in_atlas = remap_uv(foliage_mesh, vegetation_atlas.region("assets/pine.png"));
+    rotation const tree_rotation = rotation(vec3{1,0,0}, 3.14f/2);
+
+    vec2 const terrain_min = {-10,-10}, terrain_max = {10,10};
+    static_batch_tiles batch_trunk2(terrain_min, terrain_max, 3), batch_trunk3(terrain_min, terrain_max, 3);
+    static_batch_tiles batch_branches(terrain_min, terrain_max, 3), batch_foliage(terrain_min, terrain_max, 3);
+    for (vec3 pi : tree_position1){
+        batch_trunk2.add(trunk_mesh, affine_rts(tree_rotation, pi, 1.0f));
+        batch_branches.add(branches_mesh, affine_rts(tree_rotation, pi, 1.0f));
+    }
+    for (vec3 pi : tree_position2){
+        batch_trunk2.add(trunk_mesh, affine_rts(tree_rotation, pi, 0.8f));
+        batch_branches.add(branches_mesh, affine_rts(tree_rotation, pi, 0.8f));
+    }
+    for (vec3 pi : tree_position3){
+        batch_trunk3.add(trunk_mesh, affine_rts(tree_rotation, pi, 0.9f));
+        batch_branches.add(branches_mesh, affine_rts(tree_rotation, pi, 0.9f));
+        batch_foliage.add(foliage_mesh, affine_rts(tree_rotation, pi, 0.9f));
+    }
+    for (vec3 pi : tree_position4){
+        batch_trunk3.add(trunk_mesh, affine_rts(tree_rotation, pi, 1.0f));
+        batch_branches.add(branches_mesh, affine_rts(tree_rotation, pi, 1.0f));
+        batch_foliage.add(foliage_mesh, affine_rts(tree_rotation, pi, 1.0f));
+    }
+
+    trunk2.shader = shader_mesh;
+    trunk2.texture = texture_white;
+
+    trunk3.shader = shader_mesh;
+    trunk3.texture = assets.texture("assets/trunk.png");
+
+    branches.shader = shader_mesh;
+    branches.texture = texture_white;
+    branches.shading.color = {0.45f, 0.41f, 0.34f}; // branches do not have textures
+
+    foliage2.texture = foliage_in_atlas ? vegetation_texture : assets.texture("assets/pine.png");
+    foliage2.shader = shader_with_transparency; // set the shader handling transparency for the foliage
+    foliage2.shading.phong = {0.4f, 0.6f, 0, 1};     // remove specular effect for the billboard
+
+    add_static_tiles(batch_trunk2, trunk2);
+    add_static_tiles(batch_trunk3, trunk3);
+    add_static_tiles(batch_branches, branches);
+    add_static_tiles(batch_foliage, foliage2);
+
+    // Street lamps and their torus share the same material
+    mesh const street_lamp_mesh = cached_mesh("street_lamp", cache_key().add(street_lamp_revision), create_street_lamp);
+    mesh torus = mesh_primitive_torus(0.08f, 0.02f, {0,0,0}, {0,0,1}, 20,20);
+    torus.color.fill({0,0,0});
+
+    static_batch batch_street_lamp;
+    for (vec3 pi : street_lamp_position){
+        batch_street_lamp.add(street_lamp_mesh, affine_rts(rotation(), pi, 1.0f));
+        batch_street_lamp.add(torus, affine_rts(rotation(), {pi.x, pi.y, pi.z + 1.1f}, 1.0f));
+    }
+    add_static_object(mesh_drawable(batch_street_lamp.merged), bounding_sphere_of(batch_street_lamp.merged));
+
+    add_static_object(fontaine, transform_bounding_sphere(bounding_sphere_of(fontaine_mesh), fontaine.transform));
+    add_static_object(statue, transform_bounding_sphere(bounding_sphere_of(statue_mesh), statue.transform));
+
+    // The grass tufts never move: their instances are computed once, the visible ones are sent at each frame
+    for (vec3 pi : grass_position){
+        pi = pi - vec3(0.0f,0.0f,0.15f);
+        grass_tufts.push_back(instance_transform(affine_rts(rotation(), pi, billboard_grass.transform.scale)));
+        grass_tufts.push_back(instance_transform(affine_rts(rotation(vec3{0,0,1}, 3.14f/2), pi, billboard_grass.transform.scale)));
+        culling_spheres.push_back({pi + vec3(0,0,0.2f), 0.3f});
+    }
+    grass_instanced = mesh_drawable_instanced(billboard_grass);
+
+    scene_bvh.build(culling_spheres);
 
     /** *************************************************************  **/
     /** Trajectoire oiseau  **/
@@ -275,27 +462,45 @@ void initialize_data()
     timer.t_max = key_times[6];  // Ends the timer at the last time of the keyframe
     timer.t = timer.t_min;
 
+    // Display of the trajectory: samples at fixed times over the animation
+    user.gui.display_trajectory = false;
+    trajectory = trajectory_drawable(user.gui.trajectory_storage);
+    trajectory_times.resize(user.gui.trajectory_storage);
+    trajectory_samples.resize(user.gui.trajectory_storage);
+    for (size_t k = 0; k < trajectory_times.size(); ++k)
+        trajectory_times[k] = timer.t_min + (timer.t_max-timer.t_min)*k/(trajectory_times.size()-1.0f);
+    trajectory_times.back() = timer.t_max;
+
+    // Sanity check: the batch evaluation matches the single one up to the bounds of the animation
+    trajectory_sampling.evaluate(trajectory_track, trajectory_times.data(), trajectory_times.size(), trajectory_samples.data());
+    assert_vcl( norm(trajectory_samples.front()-interpolation(timer.t_min, key_positions, key_times))<1e-4f, "Batch evaluation of the trajectory differs at t_min");
+    assert_vcl( norm(trajectory_samples.back()-interpolation(timer.t_max, key_positions, key_times))<1e-4f, "Batch evaluation of the trajectory differs at t_max");
+
     /** *************************************************************  **/
     /** Oiseaux  **/
     /** *************************************************************  **/
 
-    hierarchy1 = create_birds();
+    birds_lod.initialize(shader_instanced_transparency, assets.texture("assets/bird.png"));
+    birds.initialize(user.gui.flock_size, key_positions[1], 2.0f);
 
     /** *************************************************************  **/
     /** Goutte à goutte **/
     /** *************************************************************  **/
 
-    float const r = 0.01f; // rayon de la goutte
-    sphere = mesh_drawable( mesh_primitive_sphere(r));
-    sphere.texture = opengl_texture_to_gpu(image_load_png("assets/water.png"));
+    sphere = mesh_drawable( mesh_primitive_sphere(drop_radius));
+    sphere.texture = assets.texture("assets/water.png"); // same texture as the grid
+    sphere_instanced = mesh_drawable_instanced(sphere);
 
     /** *************************************************************  **/
     /** Flocons de neige**/
     /** *************************************************************  **/
 
-    float const rayon = 0.02f; // rayon du flocon
-    snow = mesh_drawable( mesh_primitive_sphere(rayon));
+    snow = mesh_drawable( mesh_primitive_sphere(flake_radius));
     snow.shading.color = {1.0f,1.0f,1.0f};
+    snow_instanced = mesh_drawable_instanced(snow);
+
+    // The drops, the snow and the key positions of the bird are simulated with a fixed time step (see simulation.hpp)
+    simulation.initialize(terrain_field, key_positions, key_times, timer.t_min, timer.t_max);
 
     /** *************************************************************  **/
     /** Boules lumineuses  **/
@@ -305,6 +510,11 @@ void initialize_data()
     sphere_spotlight_mesh.flip_connectivity();
     sphere_spotlight = mesh_drawable( sphere_spotlight_mesh );
 
+    // The street lamps never move: their spotlights are static
+    scene_lights.set_falloff(scene.spotlight_falloff);
+    for (vec3 const& p : street_lamp_position)
+        scene_lights.add_static({p.x, p.y, p.z + 1.1f}, {0.75, 0.75, 0.8});
+
     /** *************************************************************  **/
 
 }
@@ -312,282 +522,184 @@ void initialize_data()
 
 void display_scene()
 {
-
-    draw(terrain, scene);
     // Update the current time
     float const dt = timer.update();
-    float t = timer.t;
-
-
-    /** *************************************************************  **/
-    /** Boules lumineuses  **/
-    /** *************************************************************  **/
+    scene.t = timer.t; // send the current time to the shader as a uniform parameter
 
+    // Only the objects intersecting the view frustum are displayed
+    mat4 const view_matrix = scene.camera.matrix_view();
+    frustum const view(scene.projection * view_matrix);
 
-    // set the values for the spotlights (possibly varying in time)
-    for (size_t k = 0; k < street_lamp_position.size(); ++k)
-    {
-        scene.spotlight_color[k] = {0.75, 0.75, 0.8};
-        scene.spotlight_position[k] = {street_lamp_position[k].x, street_lamp_position[k].y, street_lamp_position[k].z + 1.1f};
-    }
+    // State of the simulation one tick in the past: the positions are interpolated between its last two ticks
+    simulation_frame const& state = simulation.acquire();
+    float const alpha = simulation.alpha;
+    float const t = state.t>=state.t_previous ? (1-alpha)*state.t_previous + alpha*state.t : state.t;
+    key_positions = state.key_positions;
 
-    // display the spotlights as small spheres
-    for (size_t k = 0; k < scene.spotlight_position.size(); ++k)
-    {
-        sphere_spotlight.transform.translate = scene.spotlight_position[k];
-        sphere_spotlight.shading.color = scene.spotlight_color[k];
-        draw(sphere_spotlight, scene);
-    }
+    // Sanity check
+    assert_vcl( key_times.size()==key_positions.size(), "key_time and key_positions should have the same size");
 
-    draw(moon,scene);
 
     /** *************************************************************  **/
-    /** Arbres, fontaine, statue et lampadaires  **/
+    /** Tâches du CPU  **/
     /** *************************************************************  **/
 
-        for (vec3 pi : tree_position1){
-            trunk2.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
-            branches.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
-            foliage2.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
-
-            trunk2.transform.translate = pi;
-            branches.transform.translate = pi;
-            foliage2.transform.translate = pi;
-
-            draw(trunk2, scene);
-            draw(branches, scene);
+    // The CPU work of the frame is submitted to the job system, then waited for before the draw phase:
+    //  the systems run on every core (the larger ones split themselves with parallel_for), OpenGL is only called afterward
+    job_system& jobs = job_system::global();
+    job_counter frame_jobs;
+
+    // Lists of lights of the clusters, only rebuilt when the camera or the lights changed (the dynamic lights would be moved before)
+    scene_lights.set_falloff(scene.spotlight_falloff);
+    jobs.submit(frame_jobs, [&](){ spotlight_clusters.bin(scene.projection, view_matrix, scene_lights); });
+
+    // Trees (one draw call per material and visible tile), street lamps, fontaine, statue and grass tufts
+    jobs.submit(frame_jobs, [&](){
+        scene_bvh.cull(view, visible_objects);
+        grass_visible.clear();
+        for (uint32_t k : visible_objects) {
+            if (k >= static_objects.size()) {
+                size_t const tuft = k - static_objects.size();
+                grass_visible.push_back(grass_tufts[2*tuft]);
+                grass_visible.push_back(grass_tufts[2*tuft+1]);
+            }
         }
-
-        for (vec3 pi : tree_position2){
-            trunk2.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
-            branches.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
-            foliage2.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
-
-            trunk2.transform.translate = pi;
-            branches.transform.translate = pi;
-
-            trunk2.transform.scale = (0.8,0.8,0.8);
-            branches.transform.scale = (0.8,0.8,0.8);
-
-            draw(trunk2, scene);
-            draw(branches, scene);
+    });
+
+    // The flock follows the bird, each bird keeps its own flapping of the wings
+    jobs.submit(frame_jobs, [&](){
+        vec3 const p = interpolation(t, bird_track);
+        //Find the direction of trajectory
+        float const ankl = direction(t, bird_track, dir);
+        birds.update(std::min(dt, 0.05f), p, terrain_field);
+
+        // Bird trajectory and rotation of wings, for the leading bird then the flock
+        bird_poses.resize(birds.size()+1);
+        bird_poses[0] = {p, ankl, bird_wing_angle(t)};
+        for (size_t k = 0; k < birds.size(); ++k)
+            bird_poses[k+1] = {birds.position[k], birds.heading(k), bird_wing_angle(t + birds.phase[k])};
+    });
+
+    // Instances of the rain drops and of the snowflakes intersecting the view frustum
+    jobs.submit(frame_jobs, [&](){
+        drop_instances.clear();
+        for(size_t k=0; k<state.drops.size(); ++k) {
+            vec3 const p = (1-alpha)*state.drops_previous[k] + alpha*state.drops[k];
+            if(view.intersect({p, drop_radius}))
+                drop_instances.push_back(instance_translation(p));
         }
+    });
+    jobs.submit(frame_jobs, [&](){
+        // The visible flakes of each chunk are packed at the start of the chunk in parallel, then the chunks are concatenated
+        size_t const N = state.flakes.size();
+        size_t const chunk = 4096;
+        size_t const N_chunk = (N+chunk-1)/chunk;
+        flake_instances.resize(N);
+        flake_chunk_visible.resize(N_chunk);
+        parallel_for(0, N_chunk, [&](size_t c_begin, size_t c_end) {
+            for(size_t c=c_begin; c<c_end; ++c) {
+                size_t n = c*chunk;
+                for(size_t k=c*chunk; k<std::min(N, (c+1)*chunk); ++k) {
+                    vec3 const p = (1-alpha)*state.flakes_previous[k] + alpha*state.flakes[k];
+                    if(view.intersect({p, flake_radius}))
+                        flake_instances[n++] = instance_translation(p);
+                }
+                flake_chunk_visible[c] = n-c*chunk;
+            }
+        });
+        size_t n = 0;
+        for(size_t c=0; c<N_chunk; ++c) {
+            if(n<c*chunk)
+                std::copy(flake_instances.begin()+c*chunk, flake_instances.begin()+c*chunk+flake_chunk_visible[c], flake_instances.begin()+n);
+            n += flake_chunk_visible[c];
+        }
+        flake_instances.resize(n);
+    });
 
+    jobs.wait(frame_jobs);
 
-        for (vec3 pi : tree_position3){
-            trunk3.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
-            branches.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
-            foliage2.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
-
-            trunk3.transform.translate = pi;
-            branches.transform.translate = pi;
-            foliage2.transform.translate = pi;
-
-            trunk3.transform.scale = (0.9,0.9,0.9);
-            branches.transform.scale = (0.9,0.9,0.9);
-            foliage2.transform.scale = (0.9,0.9,0.9);
 
-            draw(trunk3, scene);
-            draw(branches, scene);
-            draw(foliage2, scene);
-        }
+    // The per-frame uniforms are sent once before drawing: they are all set here
+    spotlight_clusters.upload(scene_lights);
+    scene_uniforms.update(scene.projection, view_matrix, scene.light, scene.t, scene.spotlight_falloff, scene.fog_falloff, spotlight_clusters);
 
-        for (vec3 pi : tree_position4){
-            trunk3.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
-            branches.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
-            foliage2.transform.rotate = rotation(vec3{1,0,0}, 3.14f/2);
+    if(user.gui.display_frame) draw(user.global_frame, scene);
 
-            trunk3.transform.translate = pi;
-            branches.transform.translate = pi;
-            foliage2.transform.translate = pi;
+    draw(terrain, scene);
+    terrain_streaming.update(scene.camera.position(), view);
+    draw(terrain_streaming, scene);
 
-            draw(trunk3, scene);
-            draw(branches, scene);
-            draw(foliage2, scene);
-        }
 
+    /** *************************************************************  **/
+    /** Boules lumineuses  **/
+    /** *************************************************************  **/
 
 
-        for (vec3 pi : street_lamp_position){
-            street_lamp.transform.translate = pi;
-            tore.transform.translate = {pi.x, pi.y, pi.z + 1.1f};
-            draw(street_lamp, scene);
-            draw(tore, scene);
-        }
+    // display the registered spotlights as small spheres
+    for (size_t k = 0; k < scene_lights.size(); ++k)
+    {
+        if (!view.intersect({scene_lights.position[k], 0.05f}))
+            continue;
+        sphere_spotlight.transform.translate = scene_lights.position[k];
+        sphere_spotlight.shading.color = scene_lights.color[k];
+        draw(sphere_spotlight, scene);
+    }
 
-        //Draw fontaine
-        fontaine.transform.translate = {-2.5,1.0f, 0.2};
-        draw(fontaine,scene);
+    draw(moon,scene);
 
-        //Draw statue
-        statue.transform.translate = {6,-1.0f, 1.3};
-        statue.transform.rotate = rotation(vec3{0,0,-1}, 3.14f/2);
-        draw(statue,scene);
+    /** *************************************************************  **/
+    /** Arbres, fontaine, statue et lampadaires  **/
+    /** *************************************************************  **/
 
-        // Sanity check
-        assert_vcl( key_times.size()==key_positions.size(), "key_time and key_positions should have the same size");
+        for (uint32_t k : visible_objects)
+            if (k < static_objects.size())
+                draw(static_objects[k], scene);
 
         if( t<timer.t_min+0.1f ) // clear trajectory when the timer restart
         trajectory.clear();
 
-
-        // Compute the interpolated position
-        if (t > key_times[5]){
-
-       key_positions[0] = key_positions[5];
-       key_positions[1] = key_positions[6];
-
-       float u = rand_interval(0.1);
-       float v = rand_interval(0,1);
-
-       key_positions[2] = vec3(evaluate_terrain(u,v).x, evaluate_terrain(u,v).y, evaluate_terrain(u,v).z+
-                               7.5f + rand_interval(0,2));
-
-       u = rand_interval(0.1);
-       v = rand_interval(0,1);
-       key_positions[3] = vec3(evaluate_terrain(u,v).x, evaluate_terrain(u,v).y, evaluate_terrain(u,v).z+
-                               7.5f + rand_interval(0,2));
-       }
-       else if (t < key_times[2]){
-
-       float u4 = rand_interval(0,1);
-       float v4 = rand_interval(0,1);
-       vec3 pos4 = evaluate_terrain(u4,v4);
-       key_positions[4] = vec3(pos4.x, pos4.y, pos4.z + 7.5f + rand_interval(0,2));
-
-       u4 = rand_interval(0.1);
-       v4 = rand_interval(0,1);
-       pos4 = evaluate_terrain(u4,v4);
-       key_positions[5] = vec3(pos4.x, pos4.y, pos4.z + 7.5f + rand_interval(0,2));
-
-       u4 = rand_interval(0.1);
-       v4 = rand_interval(0,1);
-       pos4 = evaluate_terrain(u4,v4);
-       key_positions[6] = vec3(pos4.x, pos4.y, pos4.z + 7.5f + rand_interval(0,2));
-       key_positions[7] = key_positions[6];
-       }
-
     /** *************************************************************  **/
     /** Oiseaux **/
     /** *************************************************************  **/
 
-    vec3 const p = interpolation(t, key_positions, key_times);
-    //Find the direction of trajectory
-    float const ankl = direction(t, key_positions, key_times, dir);
-
-    // Bird trajectory
-    hierarchy1["body"].transform.translate = p;
-    hierarchy1["body"].transform.rotate = rotation({0,0,1}, ankl);
-
-    // Rotation of wings
-    hierarchy1["shoulder_left"].transform.rotate = rotation({0,0.7,0}, 0.8*std::sin(-5.5*3.14f*(t-0.15f)));
-    hierarchy1["shoulder_right"].transform.rotate = rotation({0,0.7,0}, 0.8*std::sin(5.5*3.14f*(t-0.15f)));
-
-   // update the global coordinates
-   hierarchy1.update_local_to_global_coordinates();
-
-   // display the hierarchy
+   // update the global coordinates of every part of every bird, and display them with one draw call per part and level of detail
+   float const pixels_per_unit = 0.5f*scene.window_height/std::tan(0.5f*scene.field_of_view);
+   birds_lod.update(bird_poses, scene.camera.position(), pixels_per_unit, view);
    if(user.gui.display_surface)
-           draw(hierarchy1, scene);
+           draw(birds_lod, scene);
+
+   // display the whole trajectory, evaluated in a single batch (the key positions may have changed)
+   if(user.gui.display_trajectory) {
+           trajectory_sampling.evaluate(trajectory_track, trajectory_times.data(), trajectory_times.size(), trajectory_samples.data());
+           trajectory.clear();
+           for (size_t k = 0; k < trajectory_samples.size(); ++k)
+                   trajectory.add(trajectory_samples[k], trajectory_times[k]);
+           draw(trajectory, scene);
+   }
 
     /** *************************************************************  **/
     /** Goutte à goutte  **/
     /** *************************************************************  **/
 
-        if (t<timer.t_min+0.1f) {
-                particles.push_back({vec3({-2.0f,2.0f, 1.5}),vec3(0,0,0)});
-        }
-
-        // Evolve position of particles
-    const vec3 g = {0.0f,0.0f,-9.81f};
-    for(particle_structure& particle : particles)
-    {
-        const float m = 0.01f; // particle mass
-
-        vec3& p = particle.p;
-        vec3& v = particle.v;
-
-        const vec3 F = m*g;
-
-        // Numerical integration
-        if (p[2] < evaluate_terrain((p[0]/20)+0.5f, (p[1]/20)+0.5f).z + 0.05f){
-            v = vec3(0.9*v.x, 0.9*v.y, - 0.7*v.z);
-            //vec3 u = shader_mesh.fragment.normal;
-            p[2] = evaluate_terrain((p[0]/20)+0.5f, (p[1]/20)+0.5f).z +0.05f;
-        }
-        else {
-            v = v + dt*F/m;
-            p = p + dt*v;
-        }
-    }
-
-        // Remove particles that are too low
-    for(auto it = particles.begin(); it!=particles.end(); ){
-        if( it->p.z < -3)
-            it = particles.erase(it);
-                if(it!=particles.end())
-                        ++it;
-         if (it -> p.y == -6 && p.z<0){
-             it = particles.erase(it);
-                 if(it!=particles.end())
-                         ++it;
-         }
-        }
-
-        // Display particles
-    for(particle_structure& particle : particles)
-    {
-        sphere.transform.translate = particle.p;
-        draw(sphere, scene);
-    }
+        // The drops bounce on the terrain (see scene_simulation::update_drops)
+    sphere_instanced.update(drop_instances);
+    draw(sphere_instanced, scene);
 
     /** *************************************************************  **/
     /** Flocons de neige  **/
     /** *************************************************************  **/
 
-        if (t<timer.t_max) {
-                    // Initial random velocity (x,y) components are uniformly distributed along a circle.
-                    const float alpha = rand_interval(0,2*pi);
-                    const float theta = rand_interval(0,2*pi);
-                    const vec3 v0 = vec3( std::sin(alpha)*1.0f, std::cos(alpha)*1.0f, -0.5f);
-                    const float range = rand_interval(0,11.0);
-                    const vec3 p0 = vec3(0.5f + range*std::cos(theta)*1.0f, 0.5f + range*std::sin(theta)*1.0f, 20.0f);
-                    neiges.push_back({p0,v0});
-            }
-
-    for(particle_structure& particle : neiges)
-        {
-            vec3& p = particle.p;
-            vec3& v = particle.v;
-
-            const vec3 a = vec3(0.0f, 0.0f, -0.1f);
-
-            //Neige qui tombe
-            v = v + dt*(a+10*cross(a,v));
-            //On considère une accélération vers le bas (pesanteur) avec une trajectoire hélicoïdale,
-            p = p + dt*v;
-
-        }
-            // Remove particles that are too low
-        for(auto it = neiges.begin(); it!=neiges.end(); ){
-            if( it->p.x > 10 || it->p.x < -10 || it->p.y > 10 || it->p.y < -10 || it->p.z < evaluate_terrain(p.x,p.y).z-0.05f )
-                it = neiges.erase(it);
-                    if(it!=particles.end())
-                            ++it;
-            }
-            // Display particles
-        for(particle_structure& particle : neiges)
-        {
-            snow.transform.translate = particle.p;
-            draw(snow, scene);
-        }
+        //Neige qui tombe
+        //On considère une accélération vers le bas (pesanteur) avec une trajectoire hélicoïdale,
+        // les flocons touchant le terrain sous eux sont retirés (voir precipitation.hpp et simulation.hpp)
+        snow_instanced.update(flake_instances);
+        draw(snow_instanced, scene);
 
 
     /** *************************************************************  **/
     /** Fontaine  **/
     /** *************************************************************  **/
 
-    scene.t = timer.t; // send the current time to the shader as a uniform parameter
     draw(grid, scene);
 
     /** *************************************************************  **/
@@ -599,26 +711,67 @@ void display_scene()
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         glDepthMask(false);
-        for (vec3 pi : grass_position){
-            pi = pi - vec3(0.0f,0.0f,0.15f);
-            billboard_grass.transform.translate = pi;
-            billboard_grass.transform.rotate = rotation();
-            draw(billboard_grass, scene);
-            billboard_grass.transform.rotate = rotation(vec3{0,0,1}, 3.14f/2);
-            draw(billboard_grass, scene);
-        }
-
+        grass_instanced.update(grass_visible);
+        draw(grass_instanced, scene);
         glDepthMask(true);
     /** *************************************************************  **/
 
+    // The simulation runs the ticks of this frame on its thread during the end of the frame (interface, swap of the buffers),
+    //  they are displayed by the next frame
+    simulation.advance(dt, {user.gui.snow_rate});
 
 }
 
-
 void display_interface()
 {
     ImGui::SliderFloat("Time scale", &timer.scale, 0.0f, 2.0f);
+    ImGui::Checkbox("Trajectory", &user.gui.display_trajectory);
+    if(ImGui::SliderInt("Flock size", &user.gui.flock_size, 0, 5000))
+        birds.initialize(user.gui.flock_size, interpolation(timer.t, bird_track), 2.0f);
+    ImGui::SliderFloat("Snow rate", &user.gui.snow_rate, 0.0f, 20000.0f);
+    simulation_frame const& state = simulation.acquire();
+    ImGui::Text("Snowflakes: %d (%d drawn, %d landed) - simulation tick %d", int(state.flakes.size()), int(flake_instances.size()), int(state.flakes_landed), int(state.tick));
+    ImGui::Text("Visible objects: %d / %d", int(visible_objects.size()), int(scene_bvh.size()));
+    ImGui::Text("Terrain chunks: %d drawn, %d resident (%.1f MB)", int(terrain_streaming.visible()), int(terrain_streaming.resident()), terrain_streaming.memory()/1048576.0);
+    ImGui::Text("Draw calls: %d - CPU frame time: %.2f ms", int(user.statistics.last_draw_calls), 1000*user.statistics.cpu_time);
+    ImGui::Text("Programs without the scene uniform block: %d", int(shaders.last_frame_uploads));
+    ImGui::Text("Spotlights: %d (%d in view) - at most %d per cluster", int(scene_lights.size()), int(spotlight_clusters.visible_lights), int(spotlight_clusters.max_cluster_lights));
+
+    // Terrain parameters: the terrain and its cached samples are regenerated when a value changes
+    bool update = false;
+    update |= ImGui::SliderFloat("Persistance", &parameters.persistency, 0.1f, 0.6f);
+    update |= ImGui::SliderFloat("Frequency gain", &parameters.frequency_gain, 1.5f, 2.5f);
+    update |= ImGui::SliderInt("Octave", &parameters.octave, 1, 8);
+    update |= ImGui::SliderFloat("Height", &parameters.terrain_height, 0.1f, 1.5f);
+
+    if(update) {
+        auto const paused = simulation.pause(); // the simulation reads the heightfield
+        update_terrain(terrain_visual, terrain, parameters);
+        terrain_field.invalidate();
+        terrain_field.update(parameters);
+        terrain_streaming.invalidate(parameters);
+    }
+
+}
+
 
+void add_static_object(mesh_drawable const& drawable, bounding_sphere const& sphere)
+{
+    // The static objects are stored before the grass tufts
+    assert_vcl(culling_spheres.size()==static_objects.size(), "Static objects must be added before the grass tufts");
+    static_objects.push_back(drawable);
+    culling_spheres.push_back(sphere);
+}
+
+void add_static_tiles(static_batch_tiles const& batch, mesh_drawable const& material)
+{
+    for (static_batch const& tile : batch.tiles) {
+        if (tile.number_instances == 0)
+            continue;
+        mesh_drawable drawable = mesh_drawable(tile.merged, material.shader, material.texture);
+        drawable.shading = material.shading;
+        add_static_object(drawable, bounding_sphere_of(tile.merged));
+    }
 }
 
 
@@ -626,7 +779,10 @@ void window_size_callback(GLFWwindow* , int width, int height)
 {
 	glViewport(0, 0, width, height);
 	float const aspect = width / static_cast<float>(height);
-	scene.projection = projection_perspective(50.0f*pi/180.0f, aspect, 0.1f, 100.0f);
+	scene.window_height = height;
+	// Far plane at 200 (instead of 100): the streamed terrain chunks reach view_radius*chunk_size = 120 units around the camera,
+	//  up to 170 along the diagonals (see terrain_chunks.hpp). The light clusters are sliced over the same depth range
+	scene.projection = projection_perspective(scene.field_of_view, aspect, 0.1f, 200.0f);
 }
 
 
@@ -651,22 +807,34 @@ void mouse_move_callback(GLFWwindow* window, double xpos, double ypos)
 
 void opengl_uniform(GLuint shader, scene_environment const& current_scene)
 {
-	opengl_uniform(shader, "projection", current_scene.projection);
-        opengl_uniform(shader, "view", scene.camera.matrix_view());
-        opengl_uniform(shader, "light", scene.light, false);
-        opengl_uniform(shader, "time", scene.t, false); // add this parameter as uniform to the shader
+        // Called once by every draw() call
+        user.statistics.draw_calls++;
 
+        // The programs declaring the block "scene_data" read the per-frame state from the uniform buffer
+        if(shader==0 || shaders.program(shader).has_block("scene_data"))
+                return;
 
-        // Adapt the uniform values send to the shader
-        int const N_spotlight = current_scene.spotlight_color.size();
-        GLint const location_color    = glGetUniformLocation(shader, "spotlight_color");
-        GLint const location_position = glGetUniformLocation(shader, "spotlight_position");
-        glUniform3fv(location_color, N_spotlight, ptr(current_scene.spotlight_color[0]));
-        glUniform3fv(location_position, N_spotlight, ptr(current_scene.spotlight_position[0]));
+        // Other programs: the per-frame uniforms are already in the program when it has been used earlier in the frame
+        if(!shaders.frame_uniforms_needed(shader))
+                return;
+        shader_program const& program = shaders.program(shader);
+
+        // Locations resolved once at link time (-1 when the program does not use the uniform: the call is ignored)
+        glUniformMatrix4fv(program.location("projection"), 1, GL_TRUE, ptr(current_scene.projection));
+        glUniformMatrix4fv(program.location("view"), 1, GL_TRUE, ptr(current_scene.camera.matrix_view()));
+        glUniform3fv(program.location("light"), 1, ptr(current_scene.light));
+        glUniform1f(program.location("time"), current_scene.t); // add this parameter as uniform to the shader
 
-        /** Note: Here we use the raw OpenGL call to glUniform3fv allowing us to pass a vector of data (here an array of 5 positions and 5 colors) */
+        // Adapt the uniform values send to the shader
+        int const N_spotlight = std::min(int(scene_lights.size()), int(program.size("spotlight_color")));
+        if(N_spotlight>0) {
+                glUniform3fv(program.location("spotlight_color"), N_spotlight, ptr(scene_lights.color[0]));
+                glUniform3fv(program.location("spotlight_position"), N_spotlight, ptr(scene_lights.position[0]));
+        }
+        glUniform1f(program.location("spotlight_falloff"), current_scene.spotlight_falloff);
+        glUniform1f(program.location("fog_falloff"), current_scene.fog_falloff);
 
-        //opengl_uniform(shader, "spotlight_falloff", current_scene.spotlight_falloff);
+        /** Note: Here we use the raw OpenGL call to glUniform3fv allowing us to pass a vector of data (the arrays of positions and colors) */
 }
 
 
@@ -0,0 +1,127 @@
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+mapped_file::mapped_file(mapped_file&& other)
+    :address(other.address), length(other.length)
+{
+    other.address = nullptr;
+    other.length = 0;
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other)
+{
+    if(this!=&other) {
+        close();
+        std::swap(address, other.address);
+        std::swap(length, other.length);
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool mapped_file::open(std::string const& path)
+{
+    close();
+    HANDLE const file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file==INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(file, &file_size) || file_size.QuadPart==0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE const mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if(mapping==nullptr)
+        return false;
+    void const* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // the view keeps the mapping alive
+    if(view==nullptr)
+        return false;
+    address = static_cast<char const*>(view);
+    length = size_t(file_size.QuadPart);
+    return true;
+}
+
+void mapped_file::close()
+{
+    if(address!=nullptr)
+        UnmapViewOfFile(address);
+    address = nullptr;
+    length = 0;
+}
+
+bool create_directory(std::string const& path)
+{
+    return _mkdir(path.c_str())==0 || errno==EEXIST;
+}
+
+#else
+
+bool mapped_file::open(std::string const& path)
+{
+    close();
+    int const file = ::open(path.c_str(), O_RDONLY);
+    if(file<0)
+        return false;
+    struct stat status;
+    if(fstat(file, &status)!=0 || status.st_size==0) {
+        ::close(file);
+        return false;
+    }
+    void* const view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file); // the mapping stays valid after the file is closed
+    if(view==MAP_FAILED)
+        return false;
+    address = static_cast<char const*>(view);
+    length = size_t(status.st_size);
+    return true;
+}
+
+void mapped_file::close()
+{
+    if(address!=nullptr)
+        munmap(const_cast<char*>(address), length);
+    address = nullptr;
+    length = 0;
+}
+
+bool create_directory(std::string const& path)
+{
+    return mkdir(path.c_str(), 0755)==0 || errno==EEXIST;
+}
+
+#endif
+
+bool mapped_file::is_open() const
+{
+    return address!=nullptr;
+}
+
+char const* mapped_file::data() const
+{
+    return address;
+}
+
+size_t mapped_file::size() const
+{
+    return length;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/** Read-only memory mapping of a whole file
+*  - The pages are loaded by the system when they are read: opening a large file is cheap
+*  - The mapping is released by close() or the destructor */
+struct mapped_file
+{
+    mapped_file() = default;
+    ~mapped_file();
+    mapped_file(mapped_file&& other);
+    mapped_file& operator=(mapped_file&& other);
+    mapped_file(mapped_file const&) = delete;
+    mapped_file& operator=(mapped_file const&) = delete;
+
+    // Return false if the file cannot be opened (or is empty)
+    bool open(std::string const& path);
+    void close();
+
+    bool is_open() const;
+    char const* data() const;
+    size_t size() const;
+
+private:
+    char const* address = nullptr;
+    size_t length = 0;
+};
+
+// Create a directory if it does not exist yet (parent directories must exist)
+bool create_directory(std::string const& path);
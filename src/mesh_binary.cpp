@@ -0,0 +1,348 @@
+#include "mesh_binary.hpp"
+#include "mapped_file.hpp"
+#include "mesh_cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace vcl;
+
+// Increment when the layout changes: files of another version are ignored (the OBJ file is parsed instead)
+static uint32_t const mesh_binary_version = 2;
+static char const mesh_binary_magic[8] = {'I','N','F','4','4','3','M','B'};
+static uint32_t const flag_quantized = 1;
+
+mesh_loading_statistics mesh_loading;
+static std::mutex mesh_loading_mutex; // meshes may be loaded by several threads (see asset_manager)
+
+struct mesh_binary_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t vertex_count;
+    uint32_t triangle_count;
+    uint32_t stride;        // bytes per vertex
+    uint32_t vertex_offset; // offsets from the beginning of the file (aligned on 16 bytes)
+    uint32_t index_offset;
+    float position_min[3], position_max[3]; // bounding boxes used by the quantization
+    float uv_min[2], uv_max[2];
+    uint64_t source_size; // OBJ file the mesh is converted from (see mesh_source)
+    uint64_t source_hash;
+};
+
+struct vertex_full
+{
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+struct vertex_quantized
+{
+    uint16_t position[3];
+    int16_t normal[3];
+    uint16_t uv[2];
+};
+
+static_assert(sizeof(vertex_full)==32 && sizeof(vertex_quantized)==16, "Unexpected padding in the vertex layout");
+
+static uint16_t quantize_unsigned(float x, float x_min, float x_max)
+{
+    float const s = x_max>x_min ? (x-x_min)/(x_max-x_min) : 0.0f;
+    return uint16_t(std::lround(std::min(std::max(s, 0.0f), 1.0f)*65535));
+}
+
+static float dequantize_unsigned(uint16_t q, float x_min, float x_max)
+{
+    return x_min + (x_max-x_min)*(q/65535.0f);
+}
+
+static int16_t quantize_signed(float x)
+{
+    return int16_t(std::lround(std::min(std::max(x, -1.0f), 1.0f)*32767));
+}
+
+// Raw bytes of a vertex, used as key of the deduplication
+struct vertex_hash
+{
+    size_t operator()(vertex_full const& v) const
+    {
+        uint64_t h = 14695981039346656037ull;
+        unsigned char const* bytes = reinterpret_cast<unsigned char const*>(&v);
+        for(size_t k=0; k<sizeof(v); ++k) {
+            h ^= bytes[k];
+            h *= 1099511628211ull;
+        }
+        return size_t(h);
+    }
+};
+
+struct vertex_equal
+{
+    bool operator()(vertex_full const& a, vertex_full const& b) const
+    {
+        return std::memcmp(&a, &b, sizeof(vertex_full))==0;
+    }
+};
+
+static vertex_full full_vertex(mesh const& shape, size_t k)
+{
+    vertex_full v;
+    std::memset(&v, 0, sizeof(v)); // no uninitialized bytes in the hash
+    vec3 const p = shape.position[k];
+    vec3 const n = k<shape.normal.size() ? shape.normal[k] : vec3(0,0,1);
+    vec2 const t = k<shape.uv.size() ? shape.uv[k] : vec2(0,0);
+    v.position[0] = p.x; v.position[1] = p.y; v.position[2] = p.z;
+    v.normal[0] = n.x; v.normal[1] = n.y; v.normal[2] = n.z;
+    v.uv[0] = t.x; v.uv[1] = t.y;
+    return v;
+}
+
+mesh deduplicate_vertices(mesh const& shape)
+{
+    mesh result;
+    std::unordered_map<vertex_full, unsigned int, vertex_hash, vertex_equal> index_of;
+    std::vector<unsigned int> new_index(shape.position.size());
+    for(size_t k=0; k<shape.position.size(); ++k) {
+        vertex_full const v = full_vertex(shape, k);
+        auto const it = index_of.find(v);
+        if(it!=index_of.end()) {
+            new_index[k] = it->second;
+            continue;
+        }
+        unsigned int const idx = static_cast<unsigned int>(result.position.size());
+        index_of[v] = idx;
+        new_index[k] = idx;
+        result.position.push_back({v.position[0], v.position[1], v.position[2]});
+        result.normal.push_back({v.normal[0], v.normal[1], v.normal[2]});
+        result.uv.push_back({v.uv[0], v.uv[1]});
+    }
+    for(uint3 const& f : shape.connectivity)
+        result.connectivity.push_back({new_index[f[0]], new_index[f[1]], new_index[f[2]]});
+    result.fill_empty_field();
+    return result;
+}
+
+mesh_source read_mesh_source(std::string const& obj_path)
+{
+    mesh_source source;
+    mapped_file file;
+    if(!file.open(obj_path))
+        return source;
+    source.size = file.size();
+    source.hash = cache_key().add(file.data(), file.size()).value;
+    return source;
+}
+
+// Header of a binary mesh file of any version: false if the file is too small or has not the magic number
+static bool read_header(mapped_file const& file, mesh_binary_header& header)
+{
+    if(file.size()<sizeof(header))
+        return false;
+    std::memcpy(&header, file.data(), sizeof(header));
+    return std::memcmp(header.magic, mesh_binary_magic, sizeof(mesh_binary_magic))==0;
+}
+
+bool save_mesh_binary(std::string const& path, mesh const& shape_arg, mesh_source const& source, bool quantize)
+{
+    mesh const shape = deduplicate_vertices(shape_arg);
+    size_t const N = shape.position.size();
+
+    mesh_binary_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, mesh_binary_magic, sizeof(mesh_binary_magic));
+    header.version = mesh_binary_version;
+    header.flags = quantize ? flag_quantized : 0;
+    header.vertex_count = uint32_t(N);
+    header.triangle_count = uint32_t(shape.connectivity.size());
+    header.stride = quantize ? sizeof(vertex_quantized) : sizeof(vertex_full);
+    header.vertex_offset = (sizeof(header)+15) & ~15u;
+    header.index_offset = uint32_t((header.vertex_offset + N*header.stride + 15) & ~size_t(15));
+    header.source_size = source.size;
+    header.source_hash = source.hash;
+
+    for(int c=0; c<3; ++c) {
+        header.position_min[c] = N>0 ? shape.position[0][c] : 0.0f;
+        header.position_max[c] = header.position_min[c];
+    }
+    for(int c=0; c<2; ++c) {
+        header.uv_min[c] = N>0 ? shape.uv[0][c] : 0.0f;
+        header.uv_max[c] = header.uv_min[c];
+    }
+    for(size_t k=0; k<N; ++k) {
+        for(int c=0; c<3; ++c) {
+            header.position_min[c] = std::min(header.position_min[c], shape.position[k][c]);
+            header.position_max[c] = std::max(header.position_max[c], shape.position[k][c]);
+        }
+        for(int c=0; c<2; ++c) {
+            header.uv_min[c] = std::min(header.uv_min[c], shape.uv[k][c]);
+            header.uv_max[c] = std::max(header.uv_max[c], shape.uv[k][c]);
+        }
+    }
+
+    std::vector<char> vertices(N*header.stride);
+    for(size_t k=0; k<N; ++k) {
+        vertex_full const v = full_vertex(shape, k);
+        if(!quantize) {
+            std::memcpy(&vertices[k*header.stride], &v, sizeof(v));
+            continue;
+        }
+        vertex_quantized q;
+        for(int c=0; c<3; ++c) {
+            q.position[c] = quantize_unsigned(v.position[c], header.position_min[c], header.position_max[c]);
+            q.normal[c] = quantize_signed(v.normal[c]);
+        }
+        for(int c=0; c<2; ++c)
+            q.uv[c] = quantize_unsigned(v.uv[c], header.uv_min[c], header.uv_max[c]);
+        std::memcpy(&vertices[k*header.stride], &q, sizeof(q));
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if(!out)
+        return false;
+    char const zeros[16] = {};
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    out.write(zeros, header.vertex_offset-sizeof(header));
+    out.write(vertices.data(), std::streamsize(vertices.size()));
+    out.write(zeros, std::streamsize(header.index_offset - header.vertex_offset - vertices.size()));
+    if(shape.connectivity.size()>0)
+        out.write(reinterpret_cast<char const*>(&shape.connectivity[0]), std::streamsize(shape.connectivity.size()*sizeof(uint3)));
+    return bool(out);
+}
+
+bool load_mesh_binary(std::string const& path, mesh_source const& source, mesh& shape)
+{
+    mapped_file file;
+    if(!file.open(path))
+        return false;
+
+    mesh_binary_header header;
+    if(!read_header(file, header) || header.version!=mesh_binary_version)
+        return false;
+    if(source.size>0 && (header.source_size!=source.size || header.source_hash!=source.hash))
+        return false;
+    bool const quantized = (header.flags & flag_quantized)!=0;
+    if(header.stride != (quantized ? sizeof(vertex_quantized) : sizeof(vertex_full)))
+        return false;
+    if(size_t(header.vertex_offset) + size_t(header.vertex_count)*header.stride > file.size() || size_t(header.index_offset) + size_t(header.triangle_count)*sizeof(uint3) > file.size())
+        return false;
+
+    size_t const N = header.vertex_count;
+    mesh loaded;
+    loaded.position.resize(N);
+    loaded.normal.resize(N);
+    loaded.uv.resize(N);
+    char const* vertices = file.data() + header.vertex_offset;
+    for(size_t k=0; k<N; ++k) {
+        if(!quantized) {
+            vertex_full v;
+            std::memcpy(&v, vertices + k*header.stride, sizeof(v));
+            loaded.position[k] = {v.position[0], v.position[1], v.position[2]};
+            loaded.normal[k] = {v.normal[0], v.normal[1], v.normal[2]};
+            loaded.uv[k] = {v.uv[0], v.uv[1]};
+            continue;
+        }
+        vertex_quantized q;
+        std::memcpy(&q, vertices + k*header.stride, sizeof(q));
+        vec3 p, n;
+        vec2 t;
+        for(int c=0; c<3; ++c) {
+            p[c] = dequantize_unsigned(q.position[c], header.position_min[c], header.position_max[c]);
+            n[c] = q.normal[c]/32767.0f;
+        }
+        for(int c=0; c<2; ++c)
+            t[c] = dequantize_unsigned(q.uv[c], header.uv_min[c], header.uv_max[c]);
+        loaded.position[k] = p;
+        loaded.normal[k] = normalize(n);
+        loaded.uv[k] = t;
+    }
+
+    loaded.connectivity.resize(header.triangle_count);
+    if(header.triangle_count>0)
+        std::memcpy(&loaded.connectivity[0], file.data()+header.index_offset, header.triangle_count*sizeof(uint3));
+    for(uint3 const& f : loaded.connectivity)
+        if(f[0]>=N || f[1]>=N || f[2]>=N)
+            return false;
+
+    loaded.fill_empty_field(); // colors
+    shape = loaded;
+    return true;
+}
+
+std::string binary_mesh_path(std::string const& obj_path)
+{
+    size_t const dot = obj_path.find_last_of('.');
+    size_t const slash = obj_path.find_last_of("/\\");
+    if(dot==std::string::npos || (slash!=std::string::npos && dot<slash))
+        return obj_path + ".mesh";
+    return obj_path.substr(0, dot) + ".mesh";
+}
+
+mesh load_mesh(std::string const& obj_path)
+{
+    using clock = std::chrono::steady_clock;
+    clock::time_point const start = clock::now();
+
+    std::string const binary_path = binary_mesh_path(obj_path);
+    mesh_source const source = read_mesh_source(obj_path);
+    mesh shape;
+    if(load_mesh_binary(binary_path, source, shape)) {
+        std::lock_guard<std::mutex> lock(mesh_loading_mutex);
+        mesh_loading.binary_time += std::chrono::duration<double>(clock::now()-start).count();
+        mesh_loading.binary_files++;
+        return shape;
+    }
+
+    shape = mesh_load_file_obj(obj_path);
+
+    // A binary file of another source or version is converted again (a missing binary file is only written by --convert-obj)
+    mapped_file stale;
+    mesh_binary_header header;
+    if(source.size>0 && stale.open(binary_path) && read_header(stale, header)) {
+        bool const quantize = (header.flags & flag_quantized)!=0;
+        stale.close();
+        if(save_mesh_binary(binary_path, shape, source, quantize))
+            std::cout<<"Converted again the stale file "<<binary_path<<" from "<<obj_path<<std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(mesh_loading_mutex);
+    mesh_loading.obj_time += std::chrono::duration<double>(clock::now()-start).count();
+    mesh_loading.obj_files++;
+    return shape;
+}
+
+bool convert_obj_arguments(int argc, char* argv[])
+{
+    bool convert = false, quantize = false;
+    std::vector<std::string> files;
+    for(int k=1; k<argc; ++k) {
+        std::string const arg = argv[k];
+        if(arg=="--convert-obj")
+            convert = true;
+        else if(arg=="--quantize")
+            quantize = true;
+        else if(convert)
+            files.push_back(arg);
+    }
+    if(!convert)
+        return false;
+
+    for(std::string const& obj_path : files) {
+        mesh const shape = mesh_load_file_obj(obj_path);
+        std::string const path = binary_mesh_path(obj_path);
+        if(save_mesh_binary(path, shape, read_mesh_source(obj_path), quantize))
+            std::cout<<"Converted "<<obj_path<<" ("<<shape.position.size()<<" vertices) into "<<path<<std::endl;
+        else
+            std::cout<<"Cannot write "<<path<<std::endl;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+
+#include <cstdint>
+#include <string>
+
+/** Compact binary mesh file (.mesh), replacing the parsing of OBJ files at startup
+*  - Vertices are interleaved (position, normal, uv) and deduplicated: identical vertices share one index
+*  - Optional quantization: positions and uv on 16 bits relative to their bounding box, normals on 16 bits (16 bytes per vertex instead of 32)
+*  - The file is memory mapped and decoded without any parsing. The colors are not stored (filled with white)
+*  - The header stores the size and the FNV-1a hash of the OBJ file it was converted from: a file converted from another version of the OBJ file is stale */
+
+// Size and hash of the OBJ file a binary mesh is converted from (zero size if the file cannot be read)
+struct mesh_source
+{
+    uint64_t size = 0;
+    uint64_t hash = 0;
+};
+mesh_source read_mesh_source(std::string const& obj_path);
+
+// Write a mesh in the binary format
+bool save_mesh_binary(std::string const& path, vcl::mesh const& shape, mesh_source const& source, bool quantize = false);
+// Return false if the file does not exist, is not a valid binary mesh of the current version, or was converted from another source
+//  A zero source (OBJ file missing) accepts the file whatever its source
+bool load_mesh_binary(std::string const& path, mesh_source const& source, vcl::mesh& shape);
+
+// Same mesh with the identical vertices (position, normal and uv) merged
+vcl::mesh deduplicate_vertices(vcl::mesh const& shape);
+
+/** Load the binary version of an OBJ file (same path with the extension .mesh) when it exists, otherwise parse the OBJ file
+*  - A stale binary file is replaced: the OBJ file is parsed then converted again, with the same quantization
+*  - The loading time of each path is accumulated in mesh_loading (thread-safe) */
+vcl::mesh load_mesh(std::string const& obj_path);
+std::string binary_mesh_path(std::string const& obj_path);
+
+struct mesh_loading_statistics
+{
+    int binary_files = 0;
+    int obj_files = 0;
+    double binary_time = 0; // seconds
+    double obj_time = 0;
+};
+extern mesh_loading_statistics mesh_loading;
+
+// Offline conversion: argv contains "--convert-obj [--quantize] file1.obj file2.obj ...", each file is written next to the OBJ file
+//  Return false if the option is not given
+bool convert_obj_arguments(int argc, char* argv[]);
@@ -0,0 +1,143 @@
+#include "mesh_cache.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+using namespace vcl;
+
+// Increment when the layout of the cache files changes: the older files are then ignored
+static uint32_t const cache_version = 1;
+static char const cache_magic[8] = {'I','N','F','4','4','3','C','A'};
+
+std::string cache_directory = "cache";
+
+struct cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t block_count;
+    uint64_t key;
+};
+
+cache_key& cache_key::add(void const* data, size_t size)
+{
+    unsigned char const* bytes = static_cast<unsigned char const*>(data);
+    for(size_t k=0; k<size; ++k) {
+        value ^= bytes[k];
+        value *= 1099511628211ull;
+    }
+    return *this;
+}
+
+cache_key& cache_key::add(std::string const& text)
+{
+    add(text.size());
+    return add(text.data(), text.size());
+}
+
+bool cache_file::open(std::string const& path, cache_key const& key)
+{
+    offsets.clear();
+    sizes.clear();
+    if(!file.open(path))
+        return false;
+
+    cache_header header;
+    if(file.size()<sizeof(header))
+        return false;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if(std::memcmp(header.magic, cache_magic, sizeof(cache_magic))!=0 || header.version!=cache_version || header.key!=key.value)
+        return false;
+
+    size_t const table = sizeof(header) + 2*sizeof(uint64_t)*header.block_count;
+    if(file.size()<table)
+        return false;
+    offsets.resize(header.block_count);
+    sizes.resize(header.block_count);
+    for(size_t k=0; k<header.block_count; ++k) {
+        std::memcpy(&offsets[k], file.data()+sizeof(header)+2*sizeof(uint64_t)*k, sizeof(uint64_t));
+        std::memcpy(&sizes[k], file.data()+sizeof(header)+2*sizeof(uint64_t)*k+sizeof(uint64_t), sizeof(uint64_t));
+        if(offsets[k]>file.size() || sizes[k]>file.size()-offsets[k])
+            return false; // truncated file
+    }
+    return true;
+}
+
+size_t cache_file::size() const
+{
+    return offsets.size();
+}
+
+char const* cache_file::block(size_t k, size_t& bytes) const
+{
+    if(k>=offsets.size())
+        return nullptr;
+    bytes = size_t(sizes[k]);
+    return file.data()+offsets[k];
+}
+
+bool write_cache_file(std::string const& path, cache_key const& key, std::vector<cache_block> const& blocks)
+{
+    cache_header header;
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.block_count = uint32_t(blocks.size());
+    header.key = key.value;
+
+    // Offsets of the blocks, aligned on 16 bytes
+    std::vector<uint64_t> table;
+    uint64_t offset = sizeof(header) + 2*sizeof(uint64_t)*blocks.size();
+    for(cache_block const& block : blocks) {
+        offset = (offset+15) & ~uint64_t(15);
+        table.push_back(offset);
+        table.push_back(block.bytes);
+        offset += block.bytes;
+    }
+
+    std::string const temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        if(!out)
+            return false;
+        out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        out.write(reinterpret_cast<char const*>(table.data()), std::streamsize(table.size()*sizeof(uint64_t)));
+        char const zeros[16] = {};
+        uint64_t position = sizeof(header) + table.size()*sizeof(uint64_t);
+        for(size_t k=0; k<blocks.size(); ++k) {
+            out.write(zeros, std::streamsize(table[2*k]-position));
+            if(blocks[k].bytes>0)
+                out.write(static_cast<char const*>(blocks[k].data), std::streamsize(blocks[k].bytes));
+            position = table[2*k] + blocks[k].bytes;
+        }
+        if(!out)
+            return false;
+    }
+    std::remove(path.c_str()); // rename() does not replace an existing file on Windows
+    return std::rename(temporary.c_str(), path.c_str())==0;
+}
+
+std::string cache_path(std::string const& name, cache_key const& key)
+{
+    char hexadecimal[17];
+    std::snprintf(hexadecimal, sizeof(hexadecimal), "%016llx", static_cast<unsigned long long>(key.value));
+    return cache_directory + "/" + name + "-" + hexadecimal + ".bin";
+}
+
+bool load_mesh_cache(std::string const& path, cache_key const& key, mesh& shape)
+{
+    cache_file file;
+    if(!file.open(path, key) || file.size()!=5)
+        return false;
+    mesh loaded;
+    if(!file.read(0, loaded.position) || !file.read(1, loaded.normal) || !file.read(2, loaded.color) || !file.read(3, loaded.uv) || !file.read(4, loaded.connectivity))
+        return false;
+    shape = loaded;
+    return true;
+}
+
+bool save_mesh_cache(std::string const& path, cache_key const& key, mesh const& shape)
+{
+    if(!create_directory(cache_directory))
+        return false;
+    return write_cache_file(path, key, {make_cache_block(shape.position), make_cache_block(shape.normal), make_cache_block(shape.color), make_cache_block(shape.uv), make_cache_block(shape.connectivity)});
+}
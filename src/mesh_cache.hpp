@@ -0,0 +1,96 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include "mapped_file.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/** Hash (64 bits FNV-1a) of the arguments of a generator, identifying its result in the cache */
+struct cache_key
+{
+    cache_key& add(void const* data, size_t size);
+    cache_key& add(std::string const& text);
+    template <typename T> cache_key& add(T const& value);
+
+    uint64_t value = 14695981039346656037ull;
+};
+
+/** Binary file of raw data blocks, identified by a cache_key
+*  - Header: magic number, format version, key and table of the blocks (offset, size), blocks aligned on 16 bytes
+*  - The file is memory mapped: the blocks are read directly from the mapping */
+struct cache_file
+{
+    // Return false if the file does not exist, or was written for another key or format version
+    bool open(std::string const& path, cache_key const& key);
+    size_t size() const; // number of blocks
+    char const* block(size_t k, size_t& bytes) const;
+    // Copy a block into a buffer: false if its size is not a multiple of sizeof(T)
+    template <typename T> bool read(size_t k, vcl::buffer<T>& data) const;
+
+    mapped_file file;
+    std::vector<uint64_t> offsets, sizes;
+};
+
+// Raw data of a block to write
+struct cache_block
+{
+    void const* data;
+    size_t bytes;
+};
+template <typename T> cache_block make_cache_block(vcl::buffer<T> const& data);
+
+// Write the blocks in a cache file (through a temporary file renamed at the end: a reader never sees a partial file)
+bool write_cache_file(std::string const& path, cache_key const& key, std::vector<cache_block> const& blocks);
+
+// Directory of the cache files (created when needed) and path of the file of a generator
+extern std::string cache_directory;
+std::string cache_path(std::string const& name, cache_key const& key);
+
+// Mesh ready to be sent to the GPU: position, normal, color, uv and connectivity blocks
+bool load_mesh_cache(std::string const& path, cache_key const& key, vcl::mesh& shape);
+bool save_mesh_cache(std::string const& path, cache_key const& key, vcl::mesh const& shape);
+
+/** Mesh returned by generate(), read from the cache when it has already been generated with the same key
+*  - name identifies the generator: change the name (or add a revision to the key) when the generator changes */
+template <typename F>
+vcl::mesh cached_mesh(std::string const& name, cache_key const& key, F const& generate)
+{
+    std::string const path = cache_path(name, key);
+    vcl::mesh shape;
+    if(load_mesh_cache(path, key, shape))
+        return shape;
+    shape = generate();
+    save_mesh_cache(path, key, shape);
+    return shape;
+}
+
+
+template <typename T>
+cache_key& cache_key::add(T const& value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Only the raw bytes of a trivially copyable value can be hashed");
+    return add(&value, sizeof(T));
+}
+
+template <typename T>
+bool cache_file::read(size_t k, vcl::buffer<T>& data) const
+{
+    size_t bytes = 0;
+    char const* p = block(k, bytes);
+    if(p==nullptr || bytes%sizeof(T)!=0)
+        return false;
+    data.resize(bytes/sizeof(T));
+    if(bytes>0)
+        std::memcpy(&data[0], p, bytes);
+    return true;
+}
+
+template <typename T>
+cache_block make_cache_block(vcl::buffer<T> const& data)
+{
+    return {data.size()>0 ? &data[0] : nullptr, data.size()*sizeof(T)};
+}
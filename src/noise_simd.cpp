@@ -0,0 +1,360 @@
+#include "noise_simd.hpp"
+#include "vcl/vcl.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NOISE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+using namespace vcl;
+
+// The library noise (stb_perlin at z=0) is periodic on a 256 x 256 lattice, each node having an integer gradient.
+//  A single octave of vcl::noise_perlin is offset + scale*noise(p)
+namespace {
+
+struct perlin_lattice
+{
+    std::vector<float> gx, gy; // gradient of the node (i,j) stored at j+256*i
+    float offset = 0;
+    float scale = 1;
+};
+
+typedef void (*noise_kernel)(perlin_lattice const&, float const*, float const*, size_t, float*, int, float, float);
+
+struct noise_dispatch
+{
+    perlin_lattice lattice;
+    noise_kernel kernel = nullptr;
+    char const* name = "reference";
+};
+
+inline int lattice_floor(float a)
+{
+    int const ai = int(a);
+    return a<ai ? ai-1 : ai;
+}
+
+inline float ease(float a)
+{
+    return ((a*6-15)*a+10)*a*a*a;
+}
+
+inline float lerp(float a, float b, float t)
+{
+    return a+(b-a)*t;
+}
+
+inline float noise_scalar(perlin_lattice const& lattice, float x, float y)
+{
+    int const px = lattice_floor(x);
+    int const py = lattice_floor(y);
+    x -= px;
+    y -= py;
+    float const u = ease(x);
+    float const v = ease(y);
+
+    int const x0 = (px&255)<<8, x1 = ((px+1)&255)<<8;
+    int const y0 = py&255, y1 = (py+1)&255;
+    float const* gx = lattice.gx.data();
+    float const* gy = lattice.gy.data();
+    float const n00 = gx[x0+y0]*x + gy[x0+y0]*y;
+    float const n01 = gx[x0+y1]*x + gy[x0+y1]*(y-1);
+    float const n10 = gx[x1+y0]*(x-1) + gy[x1+y0]*y;
+    float const n11 = gx[x1+y1]*(x-1) + gy[x1+y1]*(y-1);
+
+    return lerp(lerp(n00,n01,v), lerp(n10,n11,v), u);
+}
+
+// Octaves of the N samples, one at a time
+void kernel_scalar(perlin_lattice const& lattice, float const* x, float const* y, size_t N, float* value, int octave, float persistency, float frequency_gain)
+{
+    for(size_t k=0; k<N; ++k) {
+        float sum = 0.0f, a = 1.0f, f = 1.0f;
+        for(int o=0; o<octave; ++o) {
+            sum += a*(lattice.offset + lattice.scale*noise_scalar(lattice, x[k]*f, y[k]*f));
+            f *= frequency_gain;
+            a *= persistency;
+        }
+        value[k] = sum;
+    }
+}
+
+void kernel_reference(perlin_lattice const&, float const* x, float const* y, size_t N, float* value, int octave, float persistency, float frequency_gain)
+{
+    for(size_t k=0; k<N; ++k)
+        value[k] = noise_perlin({x[k], y[k]}, octave, persistency, frequency_gain);
+}
+
+#ifdef NOISE_SIMD_X86
+
+// The vector kernels repeat the scalar operations in the same order, lane by lane.
+//  Lookups of the gradients are gathers (AVX2, AVX-512) or scalar loads (SSE2)
+
+__attribute__((target("sse2")))
+void kernel_sse2(perlin_lattice const& lattice, float const* x, float const* y, size_t N, float* value, int octave, float persistency, float frequency_gain)
+{
+    size_t const N4 = N - N%4;
+    __m128i const one = _mm_set1_epi32(1), mask = _mm_set1_epi32(255);
+    __m128 const c6 = _mm_set1_ps(6), c15 = _mm_set1_ps(15), c10 = _mm_set1_ps(10), c1 = _mm_set1_ps(1);
+    __m128 const offset = _mm_set1_ps(lattice.offset), scale = _mm_set1_ps(lattice.scale);
+    float const* gx = lattice.gx.data();
+    float const* gy = lattice.gy.data();
+    alignas(16) int i00[4], i01[4], i10[4], i11[4];
+
+    for(size_t k=0; k<N4; k+=4) {
+        __m128 const x0 = _mm_loadu_ps(x+k), y0 = _mm_loadu_ps(y+k);
+        __m128 sum = _mm_setzero_ps();
+        float a = 1.0f, f = 1.0f;
+        for(int o=0; o<octave; ++o) {
+            __m128 const fx = _mm_mul_ps(x0, _mm_set1_ps(f)), fy = _mm_mul_ps(y0, _mm_set1_ps(f));
+            // floor: truncation corrected for the negative values
+            __m128i px = _mm_cvttps_epi32(fx), py = _mm_cvttps_epi32(fy);
+            px = _mm_add_epi32(px, _mm_castps_si128(_mm_cmplt_ps(fx, _mm_cvtepi32_ps(px))));
+            py = _mm_add_epi32(py, _mm_castps_si128(_mm_cmplt_ps(fy, _mm_cvtepi32_ps(py))));
+            __m128 const tx = _mm_sub_ps(fx, _mm_cvtepi32_ps(px)), ty = _mm_sub_ps(fy, _mm_cvtepi32_ps(py));
+            __m128 const u = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(tx,c6),c15),tx),c10),tx),tx),tx);
+            __m128 const v = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(ty,c6),c15),ty),c10),ty),ty),ty);
+
+            __m128i const ix0 = _mm_slli_epi32(_mm_and_si128(px,mask),8), ix1 = _mm_slli_epi32(_mm_and_si128(_mm_add_epi32(px,one),mask),8);
+            __m128i const iy0 = _mm_and_si128(py,mask), iy1 = _mm_and_si128(_mm_add_epi32(py,one),mask);
+            _mm_store_si128(reinterpret_cast<__m128i*>(i00), _mm_add_epi32(ix0,iy0));
+            _mm_store_si128(reinterpret_cast<__m128i*>(i01), _mm_add_epi32(ix0,iy1));
+            _mm_store_si128(reinterpret_cast<__m128i*>(i10), _mm_add_epi32(ix1,iy0));
+            _mm_store_si128(reinterpret_cast<__m128i*>(i11), _mm_add_epi32(ix1,iy1));
+
+            __m128 const tx1 = _mm_sub_ps(tx,c1), ty1 = _mm_sub_ps(ty,c1);
+            __m128 const n00 = _mm_add_ps(_mm_mul_ps(_mm_setr_ps(gx[i00[0]],gx[i00[1]],gx[i00[2]],gx[i00[3]]),tx), _mm_mul_ps(_mm_setr_ps(gy[i00[0]],gy[i00[1]],gy[i00[2]],gy[i00[3]]),ty));
+            __m128 const n01 = _mm_add_ps(_mm_mul_ps(_mm_setr_ps(gx[i01[0]],gx[i01[1]],gx[i01[2]],gx[i01[3]]),tx), _mm_mul_ps(_mm_setr_ps(gy[i01[0]],gy[i01[1]],gy[i01[2]],gy[i01[3]]),ty1));
+            __m128 const n10 = _mm_add_ps(_mm_mul_ps(_mm_setr_ps(gx[i10[0]],gx[i10[1]],gx[i10[2]],gx[i10[3]]),tx1), _mm_mul_ps(_mm_setr_ps(gy[i10[0]],gy[i10[1]],gy[i10[2]],gy[i10[3]]),ty));
+            __m128 const n11 = _mm_add_ps(_mm_mul_ps(_mm_setr_ps(gx[i11[0]],gx[i11[1]],gx[i11[2]],gx[i11[3]]),tx1), _mm_mul_ps(_mm_setr_ps(gy[i11[0]],gy[i11[1]],gy[i11[2]],gy[i11[3]]),ty1));
+
+            __m128 const n0 = _mm_add_ps(n00, _mm_mul_ps(_mm_sub_ps(n01,n00),v));
+            __m128 const n1 = _mm_add_ps(n10, _mm_mul_ps(_mm_sub_ps(n11,n10),v));
+            __m128 const n = _mm_add_ps(n0, _mm_mul_ps(_mm_sub_ps(n1,n0),u));
+
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a), _mm_add_ps(offset, _mm_mul_ps(scale,n))));
+            f *= frequency_gain;
+            a *= persistency;
+        }
+        _mm_storeu_ps(value+k, sum);
+    }
+    kernel_scalar(lattice, x+N4, y+N4, N-N4, value+N4, octave, persistency, frequency_gain);
+}
+
+__attribute__((target("avx2")))
+void kernel_avx2(perlin_lattice const& lattice, float const* x, float const* y, size_t N, float* value, int octave, float persistency, float frequency_gain)
+{
+    size_t const N8 = N - N%8;
+    __m256i const one = _mm256_set1_epi32(1), mask = _mm256_set1_epi32(255);
+    __m256 const c6 = _mm256_set1_ps(6), c15 = _mm256_set1_ps(15), c10 = _mm256_set1_ps(10), c1 = _mm256_set1_ps(1);
+    __m256 const offset = _mm256_set1_ps(lattice.offset), scale = _mm256_set1_ps(lattice.scale);
+    float const* gx = lattice.gx.data();
+    float const* gy = lattice.gy.data();
+
+    for(size_t k=0; k<N8; k+=8) {
+        __m256 const x0 = _mm256_loadu_ps(x+k), y0 = _mm256_loadu_ps(y+k);
+        __m256 sum = _mm256_setzero_ps();
+        float a = 1.0f, f = 1.0f;
+        for(int o=0; o<octave; ++o) {
+            __m256 const fx = _mm256_mul_ps(x0, _mm256_set1_ps(f)), fy = _mm256_mul_ps(y0, _mm256_set1_ps(f));
+            __m256 const flx = _mm256_floor_ps(fx), fly = _mm256_floor_ps(fy);
+            __m256i const px = _mm256_cvttps_epi32(flx), py = _mm256_cvttps_epi32(fly);
+            __m256 const tx = _mm256_sub_ps(fx, flx), ty = _mm256_sub_ps(fy, fly);
+            __m256 const u = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(tx,c6),c15),tx),c10),tx),tx),tx);
+            __m256 const v = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(ty,c6),c15),ty),c10),ty),ty),ty);
+
+            __m256i const ix0 = _mm256_slli_epi32(_mm256_and_si256(px,mask),8), ix1 = _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(px,one),mask),8);
+            __m256i const iy0 = _mm256_and_si256(py,mask), iy1 = _mm256_and_si256(_mm256_add_epi32(py,one),mask);
+            __m256i const i00 = _mm256_add_epi32(ix0,iy0), i01 = _mm256_add_epi32(ix0,iy1), i10 = _mm256_add_epi32(ix1,iy0), i11 = _mm256_add_epi32(ix1,iy1);
+
+            __m256 const tx1 = _mm256_sub_ps(tx,c1), ty1 = _mm256_sub_ps(ty,c1);
+            __m256 const n00 = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(gx,i00,4),tx), _mm256_mul_ps(_mm256_i32gather_ps(gy,i00,4),ty));
+            __m256 const n01 = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(gx,i01,4),tx), _mm256_mul_ps(_mm256_i32gather_ps(gy,i01,4),ty1));
+            __m256 const n10 = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(gx,i10,4),tx1), _mm256_mul_ps(_mm256_i32gather_ps(gy,i10,4),ty));
+            __m256 const n11 = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(gx,i11,4),tx1), _mm256_mul_ps(_mm256_i32gather_ps(gy,i11,4),ty1));
+
+            __m256 const n0 = _mm256_add_ps(n00, _mm256_mul_ps(_mm256_sub_ps(n01,n00),v));
+            __m256 const n1 = _mm256_add_ps(n10, _mm256_mul_ps(_mm256_sub_ps(n11,n10),v));
+            __m256 const n = _mm256_add_ps(n0, _mm256_mul_ps(_mm256_sub_ps(n1,n0),u));
+
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(a), _mm256_add_ps(offset, _mm256_mul_ps(scale,n))));
+            f *= frequency_gain;
+            a *= persistency;
+        }
+        _mm256_storeu_ps(value+k, sum);
+    }
+    kernel_scalar(lattice, x+N8, y+N8, N-N8, value+N8, octave, persistency, frequency_gain);
+}
+
+// The AVX-512 intrinsics of GCC 12 raise false -Wmaybe-uninitialized warnings
+#if !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+__attribute__((target("avx512f")))
+void kernel_avx512(perlin_lattice const& lattice, float const* x, float const* y, size_t N, float* value, int octave, float persistency, float frequency_gain)
+{
+    size_t const N16 = N - N%16;
+    __m512i const one = _mm512_set1_epi32(1), mask = _mm512_set1_epi32(255);
+    __m512 const c6 = _mm512_set1_ps(6), c15 = _mm512_set1_ps(15), c10 = _mm512_set1_ps(10), c1 = _mm512_set1_ps(1);
+    __m512 const offset = _mm512_set1_ps(lattice.offset), scale = _mm512_set1_ps(lattice.scale);
+    float const* gx = lattice.gx.data();
+    float const* gy = lattice.gy.data();
+
+    for(size_t k=0; k<N16; k+=16) {
+        __m512 const x0 = _mm512_loadu_ps(x+k), y0 = _mm512_loadu_ps(y+k);
+        __m512 sum = _mm512_setzero_ps();
+        float a = 1.0f, f = 1.0f;
+        for(int o=0; o<octave; ++o) {
+            __m512 const fx = _mm512_mul_ps(x0, _mm512_set1_ps(f)), fy = _mm512_mul_ps(y0, _mm512_set1_ps(f));
+            __m512 const flx = _mm512_floor_ps(fx), fly = _mm512_floor_ps(fy);
+            __m512i const px = _mm512_cvttps_epi32(flx), py = _mm512_cvttps_epi32(fly);
+            __m512 const tx = _mm512_sub_ps(fx, flx), ty = _mm512_sub_ps(fy, fly);
+            __m512 const u = _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_sub_ps(_mm512_mul_ps(tx,c6),c15),tx),c10),tx),tx),tx);
+            __m512 const v = _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_sub_ps(_mm512_mul_ps(ty,c6),c15),ty),c10),ty),ty),ty);
+
+            __m512i const ix0 = _mm512_slli_epi32(_mm512_and_epi32(px,mask),8), ix1 = _mm512_slli_epi32(_mm512_and_epi32(_mm512_add_epi32(px,one),mask),8);
+            __m512i const iy0 = _mm512_and_epi32(py,mask), iy1 = _mm512_and_epi32(_mm512_add_epi32(py,one),mask);
+            __m512i const i00 = _mm512_add_epi32(ix0,iy0), i01 = _mm512_add_epi32(ix0,iy1), i10 = _mm512_add_epi32(ix1,iy0), i11 = _mm512_add_epi32(ix1,iy1);
+
+            __m512 const tx1 = _mm512_sub_ps(tx,c1), ty1 = _mm512_sub_ps(ty,c1);
+            __m512 const n00 = _mm512_add_ps(_mm512_mul_ps(_mm512_i32gather_ps(i00,gx,4),tx), _mm512_mul_ps(_mm512_i32gather_ps(i00,gy,4),ty));
+            __m512 const n01 = _mm512_add_ps(_mm512_mul_ps(_mm512_i32gather_ps(i01,gx,4),tx), _mm512_mul_ps(_mm512_i32gather_ps(i01,gy,4),ty1));
+            __m512 const n10 = _mm512_add_ps(_mm512_mul_ps(_mm512_i32gather_ps(i10,gx,4),tx1), _mm512_mul_ps(_mm512_i32gather_ps(i10,gy,4),ty));
+            __m512 const n11 = _mm512_add_ps(_mm512_mul_ps(_mm512_i32gather_ps(i11,gx,4),tx1), _mm512_mul_ps(_mm512_i32gather_ps(i11,gy,4),ty1));
+
+            __m512 const n0 = _mm512_add_ps(n00, _mm512_mul_ps(_mm512_sub_ps(n01,n00),v));
+            __m512 const n1 = _mm512_add_ps(n10, _mm512_mul_ps(_mm512_sub_ps(n11,n10),v));
+            __m512 const n = _mm512_add_ps(n0, _mm512_mul_ps(_mm512_sub_ps(n1,n0),u));
+
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_set1_ps(a), _mm512_add_ps(offset, _mm512_mul_ps(scale,n))));
+            f *= frequency_gain;
+            a *= persistency;
+        }
+        _mm512_storeu_ps(value+k, sum);
+    }
+    kernel_scalar(lattice, x+N16, y+N16, N-N16, value+N16, octave, persistency, frequency_gain);
+}
+#if !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+// Read the gradients of the lattice from single octaves of vcl::noise_perlin
+//  Along the edge (i,j)-(i+1,j) the noise is (1-ease(t)) gx(i,j) t + ease(t) gx(i+1,j) (t-1): close to gx(i,j) t for a small t
+bool read_lattice(perlin_lattice& lattice)
+{
+    float const dt = 1.0f/64;
+    lattice.offset = noise_perlin({0,0}, 1, 1, 1); // the noise vanishes on the nodes
+    lattice.gx.resize(256*256);
+    lattice.gy.resize(256*256);
+
+    float slope_max = 0;
+    for(int i=0; i<256; ++i) {
+        for(int j=0; j<256; ++j) {
+            lattice.gx[j+256*i] = (noise_perlin({i+dt, float(j)}, 1, 1, 1)-lattice.offset)/dt;
+            lattice.gy[j+256*i] = (noise_perlin({float(i), j+dt}, 1, 1, 1)-lattice.offset)/dt;
+            slope_max = std::max(slope_max, std::max(std::abs(lattice.gx[j+256*i]), std::abs(lattice.gy[j+256*i])));
+        }
+    }
+    if(slope_max==0)
+        return false;
+
+    // The gradient coordinates are integers: the largest slope is the scale of the noise
+    for(size_t k=0; k<lattice.gx.size(); ++k) {
+        lattice.gx[k] = std::round(lattice.gx[k]/slope_max);
+        lattice.gy[k] = std::round(lattice.gy[k]/slope_max);
+    }
+
+    // Exact scale from a node (i,0) where gx(i,0) != gx(i+1,0): noise(i+1/2,0) = (gx(i,0)-gx(i+1,0))/4
+    for(int i=0; i<255; ++i) {
+        float const d = lattice.gx[256*i]-lattice.gx[256*(i+1)];
+        if(d!=0) {
+            lattice.scale = (noise_perlin({i+0.5f, 0}, 1, 1, 1)-lattice.offset)/(0.25f*d);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Compare a kernel with vcl::noise_perlin on random samples
+//  Local generator: the global one used to place the objects of the scene is not consumed (the first call may come from any thread)
+bool validate(perlin_lattice const& lattice, noise_kernel kernel)
+{
+    size_t const N = 1000;
+    std::vector<float> x(N), y(N), value(N);
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> coordinate(-300.0f, 300.0f);
+    for(size_t k=0; k<N; ++k) {
+        x[k] = coordinate(generator);
+        y[k] = coordinate(generator);
+    }
+    int const octave = 7;
+    float const persistency = 0.42f, frequency_gain = 2.5f;
+    kernel(lattice, x.data(), y.data(), N, value.data(), octave, persistency, frequency_gain);
+    for(size_t k=0; k<N; ++k) {
+        float const reference = noise_perlin({x[k], y[k]}, octave, persistency, frequency_gain);
+        if(!(std::abs(value[k]-reference) <= 1e-4f*(1+std::abs(reference))))
+            return false;
+    }
+    return true;
+}
+
+noise_dispatch create_dispatch()
+{
+    noise_dispatch dispatch;
+    dispatch.kernel = kernel_reference;
+    if(!read_lattice(dispatch.lattice) || !validate(dispatch.lattice, kernel_scalar))
+        return dispatch;
+    dispatch.kernel = kernel_scalar;
+    dispatch.name = "scalar";
+
+#ifdef NOISE_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && validate(dispatch.lattice, kernel_avx512)) {
+        dispatch.kernel = kernel_avx512;
+        dispatch.name = "avx512";
+    }
+    else if(__builtin_cpu_supports("avx2") && validate(dispatch.lattice, kernel_avx2)) {
+        dispatch.kernel = kernel_avx2;
+        dispatch.name = "avx2";
+    }
+    else if(__builtin_cpu_supports("sse2") && validate(dispatch.lattice, kernel_sse2)) {
+        dispatch.kernel = kernel_sse2;
+        dispatch.name = "sse2";
+    }
+#endif
+    return dispatch;
+}
+
+noise_dispatch const& dispatch()
+{
+    static noise_dispatch const d = create_dispatch(); // thread-safe initialization
+    return d;
+}
+
+}
+
+void noise_perlin_batch(float const* x, float const* y, size_t N, float* value, int octave, float persistency, float frequency_gain)
+{
+    noise_dispatch const& d = dispatch();
+    d.kernel(d.lattice, x, y, N, value, octave, persistency, frequency_gain);
+}
+
+void noise_perlin_row(float u, float const* v, size_t N, float* value, int octave, float persistency, float frequency_gain)
+{
+    thread_local std::vector<float> x;
+    x.assign(N, u);
+    noise_perlin_batch(x.data(), v, N, value, octave, persistency, frequency_gain);
+}
+
+char const* noise_perlin_kernel()
+{
+    return dispatch().name;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+/** Sum of octaves of 2D Perlin noise evaluated on batches of samples
+*  - Same result as vcl::noise_perlin(p, octave, persistency, frequency_gain) up to the float rounding
+*  - The kernel is chosen at the first call among AVX-512, AVX2, SSE2 (4/8/16 samples at once) and scalar code, depending on the CPU
+*  - The gradients of the library noise are read once at the first call and checked against vcl::noise_perlin:
+*     if they do not match, vcl::noise_perlin is called for each sample */
+void noise_perlin_batch(float const* x, float const* y, size_t N, float* value, int octave, float persistency, float frequency_gain);
+
+// Samples (u, v[k]) for k \in [0,N[ (ex. a row of the terrain)
+void noise_perlin_row(float u, float const* v, size_t N, float* value, int octave, float persistency, float frequency_gain);
+
+// Name of the kernel used: "avx512", "avx2", "sse2", "scalar", or "reference" (vcl::noise_perlin)
+char const* noise_perlin_kernel();
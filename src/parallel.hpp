@@ -0,0 +1,32 @@
+#pragma once
+
+#include "job_system.hpp"
+
+#include <algorithm>
+
+/** Split the range [begin,end[ into contiguous blocks processed by the threads of the job system (see job_system::global)
+*  - f(block_begin, block_end) is called once per block, there are a few blocks per thread so that the idle threads can steal them
+*  - The calling thread processes the first block then helps with the others: parallel_for can be called from a job
+*  - Returns once every block is processed */
+template <typename F>
+void parallel_for(size_t begin, size_t end, F const& f)
+{
+    if(end<=begin)
+        return;
+
+    job_system& jobs = job_system::global();
+    size_t const N = end-begin;
+    size_t const N_block = std::min<size_t>(jobs.size()==1 ? 1 : 4*jobs.size(), N);
+    if(N_block==1) {
+        f(begin, end);
+        return;
+    }
+
+    job_counter counter;
+    size_t const block = (N+N_block-1)/N_block;
+    for(size_t b=begin+block; b<end; b+=block)
+        jobs.submit(counter, b, std::min(b+block, end), f);
+    f(begin, begin+block); // first block on the calling thread
+
+    jobs.wait(counter);
+}
@@ -0,0 +1,111 @@
+#include "particles.hpp"
+
+#include <algorithm>
+
+using namespace vcl;
+
+particle_system::particle_system()
+{}
+
+particle_system::particle_system(size_t capacity_arg)
+    :capacity(capacity_arg), count(0),
+     px(capacity_arg), py(capacity_arg), pz(capacity_arg),
+     vx(capacity_arg), vy(capacity_arg), vz(capacity_arg),
+     qx(capacity_arg), qy(capacity_arg), qz(capacity_arg)
+{}
+
+bool particle_system::add(vec3 const& p, vec3 const& v)
+{
+    if(count>=capacity)
+        return false;
+
+    px[count] = p.x; py[count] = p.y; pz[count] = p.z;
+    vx[count] = v.x; vy[count] = v.y; vz[count] = v.z;
+    qx[count] = p.x; qy[count] = p.y; qz[count] = p.z;
+    ++count;
+    return true;
+}
+
+void particle_system::remove(size_t k)
+{
+    assert_vcl(k<count, "Remove particle "+str(k)+" out of "+str(count));
+
+    size_t const last = count-1;
+    px[k] = px[last]; py[k] = py[last]; pz[k] = pz[last];
+    vx[k] = vx[last]; vy[k] = vy[last]; vz[k] = vz[last];
+    qx[k] = qx[last]; qy[k] = qy[last]; qz[k] = qz[last];
+    count = last;
+}
+
+void particle_system::clear()
+{
+    count = 0;
+}
+
+size_t particle_system::size() const
+{
+    return count;
+}
+
+vec3 particle_system::position(size_t k) const
+{
+    return {px[k], py[k], pz[k]};
+}
+
+vec3 particle_system::velocity(size_t k) const
+{
+    return {vx[k], vy[k], vz[k]};
+}
+
+vec3 particle_system::previous_position(size_t k) const
+{
+    return {qx[k], qy[k], qz[k]};
+}
+
+void particle_system::store_previous(size_t begin, size_t end)
+{
+    std::copy(px.begin()+begin, px.begin()+end, qx.begin()+begin);
+    std::copy(py.begin()+begin, py.begin()+end, qy.begin()+begin);
+    std::copy(pz.begin()+begin, pz.begin()+end, qz.begin()+begin);
+}
+
+void particle_system::integrate(float dt, vec3 const& a)
+{
+    // Raw pointers on distinct arrays: single loop without aliasing that the compiler can vectorize
+    float* __restrict x = px.data(); float* __restrict y = py.data(); float* __restrict z = pz.data();
+    float* __restrict u = vx.data(); float* __restrict v = vy.data(); float* __restrict w = vz.data();
+    float const ax = dt*a.x, ay = dt*a.y, az = dt*a.z;
+
+    size_t const N = count;
+    for(size_t k=0; k<N; ++k)
+    {
+        u[k] += ax; v[k] += ay; w[k] += az;
+        x[k] += dt*u[k]; y[k] += dt*v[k]; z[k] += dt*w[k];
+    }
+}
+
+void particle_system::integrate_swirl(float dt, vec3 const& a, float k_swirl)
+{
+    integrate_swirl(dt, a, k_swirl, 0, count);
+}
+
+void particle_system::integrate_swirl(float dt, vec3 const& a, float k_swirl, size_t begin, size_t end)
+{
+    float* __restrict x = px.data(); float* __restrict y = py.data(); float* __restrict z = pz.data();
+    float* __restrict u = vx.data(); float* __restrict v = vy.data(); float* __restrict w = vz.data();
+    float const ax = a.x, ay = a.y, az = a.z;
+
+    for(size_t k=begin; k<end; ++k)
+    {
+        // cross(a,v) computed with the velocity before the update
+        float const cx = ay*w[k]-az*v[k];
+        float const cy = az*u[k]-ax*w[k];
+        float const cz = ax*v[k]-ay*u[k];
+
+        u[k] += dt*(ax+k_swirl*cx);
+        v[k] += dt*(ay+k_swirl*cy);
+        w[k] += dt*(az+k_swirl*cz);
+
+        x[k] += dt*u[k]; y[k] += dt*v[k]; z[k] += dt*w[k];
+    }
+}
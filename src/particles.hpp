@@ -0,0 +1,55 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include <vector>
+
+/** Pool of particles stored as a structure of arrays
+*  - The capacity is fixed at creation: no allocation when particles are added or removed
+*  - Removal swaps the last particle into the freed slot (the order of the particles is not preserved)
+*  - The positions before the last step can be kept with store_previous() (ex. to interpolate between two steps) */
+struct particle_system
+{
+    particle_system();
+    particle_system(size_t capacity);
+
+    // Add a particle, returns false (and ignores it) if the pool is full
+    bool add(vcl::vec3 const& p, vcl::vec3 const& v);
+    // Remove the particle k (swap-and-pop)
+    void remove(size_t k);
+    // Remove every particle k such that f(k) is true
+    template <typename F> void remove_if(F const& f);
+    void clear();
+
+    size_t size() const;
+    vcl::vec3 position(size_t k) const;
+    vcl::vec3 velocity(size_t k) const;
+    vcl::vec3 previous_position(size_t k) const;
+
+    // Copy the current positions of the particles [begin,end[ as their previous positions
+    void store_previous(size_t begin, size_t end);
+
+    // Explicit Euler step with a uniform acceleration: v += dt*a, p += dt*v
+    void integrate(float dt, vcl::vec3 const& a);
+    // Same with an additional swirl term making an helicoidal trajectory: v += dt*(a + k*cross(a,v))
+    void integrate_swirl(float dt, vcl::vec3 const& a, float k);
+    // Same on the particles [begin,end[ only: distinct ranges can be integrated on different threads
+    void integrate_swirl(float dt, vcl::vec3 const& a, float k, size_t begin, size_t end);
+
+    size_t capacity = 0;
+    size_t count = 0;
+    std::vector<float> px, py, pz; // positions
+    std::vector<float> vx, vy, vz; // velocities
+    std::vector<float> qx, qy, qz; // previous positions (equal to the positions for a new particle)
+};
+
+
+template <typename F> void particle_system::remove_if(F const& f)
+{
+    size_t k = 0;
+    while(k<count) {
+        if(f(k))
+            remove(k); // the particle swapped in k is tested at the next iteration
+        else
+            ++k;
+    }
+}
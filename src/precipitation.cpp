@@ -0,0 +1,138 @@
+#include "precipitation.hpp"
+#include "heightfield.hpp"
+#include "mesh_cache.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vcl;
+
+// Under this number of flakes a step runs on the calling thread only
+static size_t const parallel_threshold = 16384;
+
+pcg32::pcg32(uint64_t seed, uint64_t sequence)
+    :state(0), increment((sequence<<1u)|1u)
+{
+    next();
+    state += seed;
+    next();
+}
+
+uint32_t pcg32::next()
+{
+    uint64_t const old = state;
+    state = old*6364136223846793005ull + increment;
+    uint32_t const xorshifted = uint32_t(((old>>18u)^old)>>27u);
+    uint32_t const rotation = uint32_t(old>>59u);
+    return (xorshifted>>rotation) | (xorshifted<<((32-rotation)&31));
+}
+
+float pcg32::uniform(float a, float b)
+{
+    // 24 bits of the random integer give an exactly representable float in [0,1[
+    return a + (b-a)*((next()>>8)*(1.0f/16777216.0f));
+}
+
+
+void precipitation::initialize(precipitation_parameters const& parameters_arg)
+{
+    parameters = parameters_arg;
+    flakes = particle_system(parameters.capacity);
+    generator = pcg32(parameters.seed);
+    removed.assign(parameters.capacity, 0);
+    emission_accumulator = 0;
+    time_accumulator = 0;
+    steps = 0;
+    emitted = 0;
+    landed = 0;
+}
+
+void precipitation::emit(size_t N)
+{
+    precipitation_parameters const& e = parameters;
+    for(size_t k=0; k<N; ++k)
+    {
+        // Initial random velocity (x,y) components are uniformly distributed along a circle
+        float const alpha = generator.uniform(0, 2*pi);
+        float const theta = generator.uniform(0, 2*pi);
+        float const range = generator.uniform(0, e.radius);
+        float const z = e.height - generator.uniform(0, 1)*e.thickness;
+        vec3 const v0 = {e.speed*std::sin(alpha), e.speed*std::cos(alpha), -e.fall_speed};
+        vec3 const p0 = {e.center.x + range*std::cos(theta), e.center.y + range*std::sin(theta), z};
+        if(!flakes.add(p0, v0))
+            return;
+        emitted++;
+    }
+}
+
+int precipitation::update(float dt, heightfield const& field)
+{
+    time_accumulator += dt;
+    int n = 0;
+    while(time_accumulator>=parameters.step && n<parameters.max_steps) {
+        step(field);
+        time_accumulator -= parameters.step;
+        n++;
+    }
+    if(n==parameters.max_steps)
+        time_accumulator = std::fmod(time_accumulator, double(parameters.step)); // the simulation falls behind after a long frame
+    return n;
+}
+
+void precipitation::step(heightfield const& field)
+{
+    float const dt = parameters.step;
+
+    // Emission: the generator is only used here, on the calling thread
+    if(emitting) {
+        emission_accumulator += parameters.rate*dt;
+        size_t const N = size_t(emission_accumulator);
+        emission_accumulator -= double(N);
+        emit(N);
+    }
+
+    // Integration and collision of each flake against the terrain height below it
+    size_t const N = flakes.size();
+    vec3 const a = parameters.acceleration;
+    float const swirl = parameters.swirl;
+    float const extent = parameters.extent;
+    auto const integrate = [&](size_t b, size_t e) {
+        flakes.store_previous(b, e);
+        flakes.integrate_swirl(dt, a, swirl, b, e);
+        for(size_t k=b; k<e; ++k) {
+            float const x = flakes.px[k], y = flakes.py[k];
+            removed[k] = x>extent || x<-extent || y>extent || y<-extent || flakes.pz[k]<field.height_world(x,y)-0.05f;
+        }
+    };
+    if(N<parallel_threshold)
+        integrate(0, N);
+    else
+        parallel_for(0, N, integrate);
+
+    // Removal of the landed flakes, the order of the others is kept
+    size_t j = 0;
+    for(size_t k=0; k<N; ++k) {
+        if(removed[k])
+            continue;
+        if(j!=k) {
+            flakes.px[j] = flakes.px[k]; flakes.py[j] = flakes.py[k]; flakes.pz[j] = flakes.pz[k];
+            flakes.vx[j] = flakes.vx[k]; flakes.vy[j] = flakes.vy[k]; flakes.vz[j] = flakes.vz[k];
+            flakes.qx[j] = flakes.qx[k]; flakes.qy[j] = flakes.qy[k]; flakes.qz[j] = flakes.qz[k];
+        }
+        j++;
+    }
+    landed += N-j;
+    flakes.count = j;
+    steps++;
+}
+
+uint64_t precipitation::checksum() const
+{
+    size_t const size = flakes.size()*sizeof(float);
+    cache_key key;
+    key.add(flakes.size());
+    for(std::vector<float> const* data : {&flakes.px, &flakes.py, &flakes.pz, &flakes.vx, &flakes.vy, &flakes.vz})
+        key.add(data->data(), size);
+    return key.value;
+}
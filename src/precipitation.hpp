@@ -0,0 +1,76 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include "particles.hpp"
+
+#include <cstdint>
+#include <vector>
+
+struct heightfield;
+
+// Small PCG32 generator (O'Neill): the same seed gives the same sequence on every platform
+struct pcg32
+{
+    explicit pcg32(uint64_t seed = 1, uint64_t sequence = 1);
+    uint32_t next();
+    float uniform(float a, float b); // in [a,b[
+
+    uint64_t state = 0;
+    uint64_t increment = 0;
+};
+
+struct precipitation_parameters
+{
+    float rate = 60.0f;           // flakes emitted per second
+    float step = 1/120.0f;        // fixed integration step (s)
+    int max_steps = 8;            // steps per update at most (the late steps are dropped after a long frame)
+
+    // Emitter: disc of given radius around center, at a height in [height-thickness, height]
+    vcl::vec2 center = {0.5f, 0.5f};
+    float radius = 11.0f;
+    float height = 20.0f;
+    float thickness = 0.0f;
+    float speed = 1.0f;           // horizontal initial speed (random direction)
+    float fall_speed = 0.5f;      // initial vertical speed (downward)
+
+    // Motion: uniform acceleration with a swirl term (helicoidal trajectory, see particle_system::integrate_swirl)
+    vcl::vec3 acceleration = {0.0f, 0.0f, -0.1f};
+    float swirl = 10.0f;
+
+    float extent = 10.0f;         // flakes leaving [-extent,extent]^2 are removed
+    size_t capacity = 200000;
+    uint64_t seed = 1;
+};
+
+/** Snow (or any precipitation) emitted at a constant rate and integrated with a fixed time step
+*  - update(dt) accumulates the elapsed time and runs the whole steps it contains: the trajectories do not depend on the frame rate
+*  - On each step: emission (serial, from the seeded generator), integration and collision against the heightfield
+*     (parallel chunks of particles), then removal of the landed flakes preserving the order (serial)
+*  - For a given seed and number of steps the result is the same whatever the number of threads (see checksum())
+*  - The positions before the last step are kept in flakes (see particle_system::store_previous) */
+struct precipitation
+{
+    void initialize(precipitation_parameters const& parameters);
+    // Run the fixed steps contained in the elapsed time dt, return the number of steps
+    int update(float dt, heightfield const& field);
+    void step(heightfield const& field);
+    // Emit N flakes at once (ex. to fill the scene before a benchmark)
+    void emit(size_t N);
+
+    // Hash of the positions and velocities of the flakes
+    uint64_t checksum() const;
+
+    precipitation_parameters parameters;
+    particle_system flakes;
+    bool emitting = true;
+
+    uint64_t steps = 0;
+    size_t emitted = 0;
+    size_t landed = 0;
+
+private:
+    pcg32 generator;
+    double emission_accumulator = 0; // fractional number of flakes to emit
+    double time_accumulator = 0;     // time not simulated yet
+    std::vector<uint8_t> removed;    // flakes to remove after the current step
+};
@@ -0,0 +1,57 @@
+#include "scene_uniforms.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+using namespace vcl;
+
+// Offsets imposed by the std140 layout of the block
+static_assert(offsetof(scene_uniform_data, light)==128, "std140 layout of scene_data");
+static_assert(offsetof(scene_uniform_data, time)==144, "std140 layout of scene_data");
+static_assert(offsetof(scene_uniform_data, viewport)==160, "std140 layout of scene_data");
+static_assert(sizeof(scene_uniform_data)==208, "std140 layout of scene_data");
+
+void scene_uniform_buffer::initialize()
+{
+    data = scene_uniform_data();
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, GLsizeiptr(sizeof(scene_uniform_data)), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+}
+
+void scene_uniform_buffer::update(mat4 const& projection, mat4 const& view, vec3 const& light, float time, float spotlight_falloff, float fog_falloff,
+                                  light_clusters const& clusters)
+{
+    std::memcpy(data.projection, ptr(projection), sizeof(data.projection));
+    std::memcpy(data.view, ptr(view), sizeof(data.view));
+    data.light[0] = light.x;
+    data.light[1] = light.y;
+    data.light[2] = light.z;
+    data.light[3] = 0.0f;
+    data.time = time;
+    data.spotlight_falloff = spotlight_falloff;
+    data.fog_falloff = fog_falloff;
+    data.spotlight_count = int(clusters.light_count);
+
+    GLint viewport[4] = {0,0,1,1};
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    data.viewport[0] = float(viewport[2]);
+    data.viewport[1] = float(viewport[3]);
+    data.viewport[2] = float(viewport[0]);
+    data.viewport[3] = float(viewport[1]);
+
+    data.cluster_size[0] = int(clusters.tiles_x);
+    data.cluster_size[1] = int(clusters.tiles_y);
+    data.cluster_size[2] = int(clusters.slices);
+    data.cluster_size[3] = int(clusters.size());
+    data.cluster_depth[0] = clusters.slice_scale;
+    data.cluster_depth[1] = clusters.slice_bias;
+    data.cluster_depth[2] = clusters.z_near;
+    data.cluster_depth[3] = clusters.z_far;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, GLsizeiptr(sizeof(scene_uniform_data)), &data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
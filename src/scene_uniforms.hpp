@@ -0,0 +1,45 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include "clustered_lighting.hpp"
+
+/** CPU copy of the std140 uniform block "scene_data" declared once in shader/scene_data.glsl (inserted in the shaders by read_shader_file):
+*
+*    layout(std140, row_major) uniform scene_data {
+*        mat4 projection; mat4 view; vec4 light;
+*        float time; float spotlight_falloff; float fog_falloff; int spotlight_count;
+*        vec4 viewport; ivec4 cluster_size; vec4 cluster_depth;
+*    };
+*
+*  - The matrices are stored row by row as vcl::mat4 (hence the row_major qualifier)
+*  - vec3 are padded to vec4, as imposed by std140
+*  - The spotlights themselves are in the texture buffers of light_clusters (see clustered_lighting.hpp) */
+struct scene_uniform_data
+{
+    float projection[16];
+    float view[16];
+    float light[4];
+    float time;
+    float spotlight_falloff;
+    float fog_falloff;
+    int spotlight_count;
+    float viewport[4];       // width, height and corner (x,y) of the viewport in pixels
+    int cluster_size[4];     // tiles_x, tiles_y, slices of the light clusters
+    float cluster_depth[4];  // slice_scale, slice_bias, z_near, z_far
+};
+
+/** Uniform buffer holding the per-frame state of the scene, written once per frame
+*  - Bound to the binding point scene_uniform_buffer::binding, that every program declaring "scene_data" uses
+*     (see shader_program_registry::bind_block) */
+struct scene_uniform_buffer
+{
+    static constexpr GLuint binding = 0;
+
+    void initialize();
+    // Fill the block and send it to the GPU. The viewport is read from the current OpenGL state
+    void update(vcl::mat4 const& projection, vcl::mat4 const& view, vcl::vec3 const& light, float time, float spotlight_falloff, float fog_falloff,
+                light_clusters const& clusters);
+
+    scene_uniform_data data;
+    GLuint ubo = 0;
+};
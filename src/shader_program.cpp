@@ -0,0 +1,163 @@
+#include "shader_program.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace vcl;
+
+shader_program::shader_program(GLuint id)
+    :id(id)
+{
+    GLint count = 0;
+    GLint max_length = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+    std::vector<GLchar> name(size_t(max_length)+1);
+    for(GLint k=0; k<count; ++k)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(id, GLuint(k), GLsizei(name.size()), &length, &size, &type, name.data());
+
+        std::string uniform(name.data(), size_t(length));
+        GLint const loc = glGetUniformLocation(id, uniform.c_str());
+        if(loc<0)
+            continue; // uniform of a block
+        // Arrays are reported as "name[0]"
+        if(uniform.size()>3 && uniform.compare(uniform.size()-3, 3, "[0]")==0)
+            uniform.resize(uniform.size()-3);
+        locations[uniform] = loc;
+        sizes[uniform] = size;
+    }
+
+    GLint block_count = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &block_count);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
+    name.resize(size_t(max_length)+1);
+    for(GLint k=0; k<block_count; ++k)
+    {
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(id, GLuint(k), GLsizei(name.size()), &length, name.data());
+        blocks[std::string(name.data(), size_t(length))] = GLuint(k);
+    }
+}
+
+GLint shader_program::location(std::string const& name) const
+{
+    auto const it = locations.find(name);
+    return it!=locations.end() ? it->second : -1;
+}
+
+GLint shader_program::size(std::string const& name) const
+{
+    auto const it = sizes.find(name);
+    return it!=sizes.end() ? it->second : 0;
+}
+
+GLuint shader_program::block(std::string const& name) const
+{
+    auto const it = blocks.find(name);
+    return it!=blocks.end() ? it->second : GL_INVALID_INDEX;
+}
+
+bool shader_program::has_block(std::string const& name) const
+{
+    return blocks.find(name)!=blocks.end();
+}
+
+
+// Samplers are ordinary uniforms: the program is made current to set them (glProgramUniform needs OpenGL 4.1)
+static void set_sampler(shader_program const& program, GLint unit, std::string const& name)
+{
+    GLint const loc = program.location(name);
+    if(loc<0)
+        return;
+    GLint current = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+    glUseProgram(program.id);
+    glUniform1i(loc, unit);
+    glUseProgram(GLuint(current));
+}
+
+std::string read_shader_file(std::string const& path)
+{
+    static std::string const scene_data = read_text_file("shader/scene_data.glsl");
+
+    std::string source = read_text_file(path);
+    size_t const version = source.find("#version");
+    size_t const end_of_line = version==std::string::npos ? std::string::npos : source.find('\n', version);
+    if(end_of_line==std::string::npos)
+        return scene_data + "#line 1\n" + source;
+    size_t const line = size_t(std::count(source.begin(), source.begin()+long(end_of_line), '\n')) + 2; // line following #version
+    return source.insert(end_of_line+1, scene_data + "#line " + std::to_string(line) + "\n");
+}
+
+GLuint shader_program_registry::create(std::string const& vertex_shader, std::string const& fragment_shader)
+{
+    GLuint const id = opengl_create_shader_program(vertex_shader, fragment_shader);
+    add(id);
+    return id;
+}
+
+void shader_program_registry::add(GLuint id)
+{
+    entry& e = programs[id];
+    e.program = shader_program(id);
+    for(auto const& binding : block_bindings) {
+        GLuint const index = e.program.block(binding.first);
+        if(index!=GL_INVALID_INDEX)
+            glUniformBlockBinding(id, index, binding.second);
+    }
+    for(auto const& sampler : sampler_units)
+        set_sampler(e.program, sampler.second, sampler.first);
+}
+
+shader_program_registry::entry& shader_program_registry::find(GLuint id)
+{
+    auto const it = programs.find(id);
+    if(it!=programs.end())
+        return it->second;
+    add(id);
+    return programs[id];
+}
+
+shader_program const& shader_program_registry::program(GLuint id)
+{
+    return find(id).program;
+}
+
+void shader_program_registry::bind_block(std::string const& name, GLuint binding)
+{
+    block_bindings[name] = binding;
+    for(auto& p : programs) {
+        GLuint const index = p.second.program.block(name);
+        if(index!=GL_INVALID_INDEX)
+            glUniformBlockBinding(p.first, index, binding);
+    }
+}
+
+void shader_program_registry::bind_sampler(std::string const& name, GLint unit)
+{
+    sampler_units[name] = unit;
+    for(auto& p : programs)
+        set_sampler(p.second.program, unit, name);
+}
+
+void shader_program_registry::start_frame()
+{
+    frame++;
+    last_frame_uploads = frame_uploads;
+    frame_uploads = 0;
+}
+
+bool shader_program_registry::frame_uniforms_needed(GLuint id)
+{
+    entry& e = find(id);
+    if(e.uploaded_frame==frame)
+        return false;
+    e.uploaded_frame = frame;
+    frame_uploads++;
+    return true;
+}
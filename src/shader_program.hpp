@@ -0,0 +1,69 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+
+#include <map>
+#include <string>
+
+/** Locations of the active uniforms of a linked shader program, queried once with glGetActiveUniform
+*  - location() is a lookup in a map instead of a string query to the driver, -1 when the program does not use the uniform
+*  - Arrays are stored under their name without the "[0]" suffix (ex. "spotlight_color")
+*  - The uniform blocks are indexed by name in the same way */
+struct shader_program
+{
+    shader_program() = default;
+    explicit shader_program(GLuint id);
+
+    GLint location(std::string const& name) const;
+    // Number of elements of an array uniform (1 for a single value, 0 when the uniform is not used)
+    GLint size(std::string const& name) const;
+    // Index of a uniform block, GL_INVALID_INDEX when the program does not declare it
+    GLuint block(std::string const& name) const;
+    bool has_block(std::string const& name) const;
+
+    GLuint id = 0;
+    std::map<std::string, GLint> locations;
+    std::map<std::string, GLint> sizes;
+    std::map<std::string, GLuint> blocks;
+};
+
+/** Source of a shader file, with the uniform block scene_data (shader/scene_data.glsl) inserted after the #version line
+*  - The block is declared once for every program; a #line directive keeps the line numbers of the file in the compilation errors */
+std::string read_shader_file(std::string const& path);
+
+/** Shader programs of the scene, with the frame at which each one last received the per-frame uniforms
+*  - The per-frame uniforms (projection, view, light, spotlights, time) are kept in the state of the program once sent:
+*     the first draw call of the frame using a program uploads them, the following ones skip them
+*  - The per-frame values must therefore not change between start_frame() and the end of the frame */
+struct shader_program_registry
+{
+    // Compile, link and register a program
+    GLuint create(std::string const& vertex_shader, std::string const& fragment_shader);
+    // Programs created elsewhere are registered at their first use
+    shader_program const& program(GLuint id);
+    // Bind the uniform block name of every program (registered now or later) to a binding point
+    void bind_block(std::string const& name, GLuint binding);
+    // Set the texture unit of the sampler name of every program (registered now or later)
+    void bind_sampler(std::string const& name, GLint unit);
+
+    void start_frame();
+    // True on the first call for this program since start_frame()
+    bool frame_uniforms_needed(GLuint id);
+
+    size_t frame = 0;
+    size_t frame_uploads = 0; // programs that received the per-frame uniforms during the current frame
+    size_t last_frame_uploads = 0; // same for the last completed frame (displayed while the current one is drawn)
+
+private:
+    struct entry
+    {
+        shader_program program;
+        size_t uploaded_frame = size_t(-1);
+    };
+    entry& find(GLuint id);
+    void add(GLuint id);
+
+    std::map<GLuint, entry> programs;
+    std::map<std::string, GLuint> block_bindings;
+    std::map<std::string, GLint> sampler_units;
+};
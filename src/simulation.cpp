@@ -0,0 +1,214 @@
+#include "simulation.hpp"
+#include "heightfield.hpp"
+
+#include <algorithm>
+
+using namespace vcl;
+
+scene_simulation::~scene_simulation()
+{
+    stop();
+}
+
+void scene_simulation::initialize(heightfield const& field_arg, buffer<vec3> const& key_positions_arg, buffer<float> const& key_times_arg, float t_min_arg, float t_max_arg)
+{
+    stop();
+    field = &field_arg;
+    key_positions = key_positions_arg;
+    key_times = key_times_arg;
+    t_min = t_min_arg;
+    t_max = t_max_arg;
+    t = t_min;
+    t_previous = t_min;
+    ticks = 0;
+
+    drops = particle_system(1024);
+    precipitation_parameters snow;
+    snow.step = step; // one step of the snow per tick
+    snow.rate = controls.snow_rate;
+    snow.seed = seed;
+    snowfall.initialize(snow);
+    generator = pcg32(seed, 2);
+
+    target = 0;
+    claimed = 0;
+    frame_available = false;
+    publish(frames[frame_read]);
+    alpha = 0;
+}
+
+void scene_simulation::start()
+{
+    if(worker.joinable())
+        return;
+    stopping = false;
+    worker = std::thread([this](){ run(); });
+}
+
+void scene_simulation::stop()
+{
+    if(!worker.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_one();
+    worker.join();
+}
+
+void scene_simulation::advance(float dt, simulation_controls const& controls_arg)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        controls = controls_arg;
+        target += dt;
+        // The simulation falls behind after a long frame
+        double const target_max = (claimed+max_steps)*double(step);
+        if(target>target_max)
+            target = target_max;
+    }
+    condition.notify_one();
+}
+
+simulation_frame const& scene_simulation::acquire()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(frame_available) {
+        std::swap(frame_read, frame_published);
+        frame_available = false;
+    }
+    simulation_frame const& frame = frames[frame_read];
+
+    // Displayed time: one tick before the time to simulate, the frame is late when the worker has not caught up yet
+    double const lag = target - frame.tick*double(step);
+    alpha = float(std::min(std::max(lag/step, 0.0), 1.0));
+    return frame;
+}
+
+std::unique_lock<std::mutex> scene_simulation::pause()
+{
+    return std::unique_lock<std::mutex>(systems);
+}
+
+void scene_simulation::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for(;;) {
+        condition.wait(lock, [this](){ return stopping || (claimed+1)*double(step)<=target; });
+        if(stopping)
+            return;
+        uint64_t const N = uint64_t(target/step)-claimed;
+        claimed += N;
+        float const snow_rate = controls.snow_rate;
+        simulation_frame& frame = frames[frame_written];
+        lock.unlock();
+
+        {
+            std::lock_guard<std::mutex> running(systems);
+            snowfall.parameters.rate = snow_rate;
+            for(uint64_t k=0; k<N; ++k)
+                tick();
+            publish(frame); // only the last tick is displayed
+        }
+
+        lock.lock();
+        std::swap(frame_written, frame_published);
+        frame_available = true;
+    }
+}
+
+void scene_simulation::tick()
+{
+    // Same loop as the timer of the animation
+    t_previous = t;
+    t += step;
+    if(t>=t_max)
+        t = t_min;
+
+    update_keyframes();
+    update_drops();
+    snowfall.step(*field);
+    ticks++;
+}
+
+void scene_simulation::update_drops()
+{
+    if(t<t_min+0.1f)
+        drops.add({-2.0f, 2.0f, 1.5f}, {0, 0, 0});
+
+    // Bounce of the drops on the terrain
+    drops.store_previous(0, drops.size());
+    float const dt = step;
+    vec3 const g = {0.0f, 0.0f, -9.81f};
+    for(size_t k=0; k<drops.size(); ++k)
+    {
+        float& pz = drops.pz[k];
+        float& vx = drops.vx[k];
+        float& vy = drops.vy[k];
+        float& vz = drops.vz[k];
+
+        float const z_terrain = field->height_world(drops.px[k], drops.py[k]);
+        if(pz < z_terrain+0.05f) {
+            vx = 0.9f*vx; vy = 0.9f*vy; vz = -0.7f*vz;
+            pz = z_terrain+0.05f;
+        }
+        else {
+            vx += dt*g.x; vy += dt*g.y; vz += dt*g.z;
+            drops.px[k] += dt*vx; drops.py[k] += dt*vy; pz += dt*vz;
+        }
+    }
+
+    // Remove the drops that are too low
+    drops.remove_if([this](size_t k){ return drops.pz[k] < -3; });
+}
+
+void scene_simulation::update_keyframes()
+{
+    // While the bird flies the last segments the first key positions are drawn again, and conversely:
+    //  the segments around the current time are never modified
+    if(t>key_times[5]) {
+        key_positions[0] = key_positions[5];
+        key_positions[1] = key_positions[6];
+        key_positions[2] = random_key_position(0.1f);
+        key_positions[3] = random_key_position(0.1f);
+    }
+    else if(t<key_times[2]) {
+        key_positions[4] = random_key_position(0.0f);
+        key_positions[5] = random_key_position(0.1f);
+        key_positions[6] = random_key_position(0.1f);
+        key_positions[7] = key_positions[6];
+    }
+}
+
+vec3 scene_simulation::random_key_position(float u_min)
+{
+    float const u = generator.uniform(u_min, 1);
+    float const v = generator.uniform(0, 1);
+    vec3 const p = field->position(u, v);
+    return {p.x, p.y, p.z + 7.5f + generator.uniform(0, 2)};
+}
+
+void scene_simulation::publish(simulation_frame& frame) const
+{
+    frame.tick = ticks;
+    frame.t = t;
+    frame.t_previous = t_previous;
+    frame.key_positions = key_positions;
+
+    frame.drops.resize(drops.size());
+    frame.drops_previous.resize(drops.size());
+    for(size_t k=0; k<drops.size(); ++k) {
+        frame.drops[k] = drops.position(k);
+        frame.drops_previous[k] = drops.previous_position(k);
+    }
+
+    particle_system const& flakes = snowfall.flakes;
+    frame.flakes.resize(flakes.size());
+    frame.flakes_previous.resize(flakes.size());
+    for(size_t k=0; k<flakes.size(); ++k) {
+        frame.flakes[k] = flakes.position(k);
+        frame.flakes_previous[k] = flakes.previous_position(k);
+    }
+    frame.flakes_landed = snowfall.landed;
+}
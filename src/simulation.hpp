@@ -0,0 +1,97 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include "particles.hpp"
+#include "precipitation.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct heightfield;
+
+// Values set by the interface, read by the simulation before its next ticks
+struct simulation_controls
+{
+    float snow_rate = 60.0f; // snowflakes emitted per second
+};
+
+/** State of the simulation published for the renderer after a tick
+*  - The positions at the last tick and at the tick before are stored in the same order: the renderer interpolates between them */
+struct simulation_frame
+{
+    uint64_t tick = 0;       // number of ticks simulated since the initialization
+    float t = 0;             // time in the animation loop [t_min,t_max[ at the last tick
+    float t_previous = 0;    // same at the tick before
+    vcl::buffer<vcl::vec3> key_positions; // key positions of the bird trajectory
+    std::vector<vcl::vec3> drops, drops_previous;   // rain drops
+    std::vector<vcl::vec3> flakes, flakes_previous; // snowflakes
+    size_t flakes_landed = 0;
+};
+
+/** Rain drops, snow and key positions of the bird trajectory simulated with a fixed time step on a worker thread
+*  - The renderer adds the elapsed time with advance(dt): the worker runs the whole ticks it contains (at most max_steps,
+*     the late time is dropped after a long frame), so the trajectories do not depend on the frame rate
+*  - After its ticks the worker publishes a frame. The frames are exchanged through three buffers (written by the worker,
+*     last published, read by the renderer): neither thread waits for the other during the ticks
+*  - The renderer displays the state one tick in the past: between the two ticks of the acquired frame, with the factor alpha
+*  - The systems are only accessed by the worker, pause() stops it between two ticks (ex. while the terrain is modified)
+*  - For a given number of ticks (and the same controls) the state is the same on every run: fixed step and seeded generator */
+struct scene_simulation
+{
+    ~scene_simulation();
+
+    // The heightfield is stored by reference, the key positions and times are copied
+    void initialize(heightfield const& field, vcl::buffer<vcl::vec3> const& key_positions, vcl::buffer<float> const& key_times, float t_min, float t_max);
+    // Start (resp. stop) the worker thread, without it the simulation only advances with explicit calls to tick()
+    void start();
+    void stop();
+
+    // Render thread: add the elapsed time and wake up the worker
+    void advance(float dt, simulation_controls const& controls);
+    // Render thread: last published frame, valid until the next call. Also sets alpha
+    simulation_frame const& acquire();
+    // Render thread: the worker does not run any tick while the returned lock is held
+    std::unique_lock<std::mutex> pause();
+
+    // One tick of every system
+    void tick();
+
+    float step = 1/120.0f;
+    int max_steps = 8;
+    uint64_t seed = 1;
+    float alpha = 0; // interpolation factor between the two ticks of the acquired frame, in [0,1]
+
+private:
+    void run();
+    void publish(simulation_frame& frame) const;
+    void update_drops();
+    void update_keyframes();
+    vcl::vec3 random_key_position(float u_min);
+
+    // Systems (worker thread)
+    heightfield const* field = nullptr;
+    particle_system drops;
+    precipitation snowfall;
+    vcl::buffer<vcl::vec3> key_positions;
+    vcl::buffer<float> key_times;
+    pcg32 generator;
+    float t = 0, t_previous = 0, t_min = 0, t_max = 1;
+    uint64_t ticks = 0;
+
+    // Exchange with the render thread, protected by mutex
+    simulation_frame frames[3];
+    int frame_written = 0, frame_published = 1, frame_read = 2;
+    bool frame_available = false;
+    double target = 0;         // time to simulate since the initialization (s)
+    uint64_t claimed = 0;      // ticks claimed by the worker
+    simulation_controls controls;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable condition;
+
+    std::mutex systems; // held by the worker during its ticks
+    std::thread worker;
+};
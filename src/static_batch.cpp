@@ -0,0 +1,36 @@
+#include "static_batch.hpp"
+
+#include <algorithm>
+
+using namespace vcl;
+
+mesh transform_mesh(mesh shape, affine_rts const& transform)
+{
+    shape.fill_empty_field(); // every instance needs the same set of fields to be merged
+
+    for(vec3& p : shape.position)
+        p = transform.rotate*(transform.scale*p) + transform.translate;
+    for(vec3& n : shape.normal)
+        n = transform.rotate*n;
+
+    return shape;
+}
+
+void static_batch::add(mesh const& shape, affine_rts const& transform)
+{
+    merged.push_back(transform_mesh(shape, transform));
+    ++number_instances;
+}
+
+
+static_batch_tiles::static_batch_tiles(vec2 const& p_min_arg, vec2 const& p_max_arg, int N_arg)
+    :p_min(p_min_arg), p_max(p_max_arg), N(N_arg), tiles(N_arg*N_arg)
+{}
+
+void static_batch_tiles::add(mesh const& shape, affine_rts const& transform)
+{
+    vec3 const& p = transform.translate;
+    int const kx = std::min(std::max(int(N*(p.x-p_min.x)/(p_max.x-p_min.x)), 0), N-1);
+    int const ky = std::min(std::max(int(N*(p.y-p_min.y)/(p_max.y-p_min.y)), 0), N-1);
+    tiles[kx+N*ky].add(shape, transform);
+}
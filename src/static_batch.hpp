@@ -0,0 +1,32 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include <vector>
+
+/** Merge motionless objects sharing the same material into a single mesh
+*  - Each placed instance is transformed on the CPU and appended to the merged mesh
+*  - The merged mesh is then displayed with a single mesh_drawable (identity transform) */
+struct static_batch
+{
+    // Append the shape placed with the given transformation
+    void add(vcl::mesh const& shape, vcl::affine_rts const& transform);
+
+    vcl::mesh merged;
+    size_t number_instances = 0;
+};
+
+/** Static batches split on a regular grid of N x N tiles over [p_min,p_max] in the (x,y) plane
+*  - Each instance goes to the tile containing its translation: the tiles can then be culled separately */
+struct static_batch_tiles
+{
+    static_batch_tiles(vcl::vec2 const& p_min, vcl::vec2 const& p_max, int N);
+    void add(vcl::mesh const& shape, vcl::affine_rts const& transform);
+
+    vcl::vec2 p_min;
+    vcl::vec2 p_max;
+    int N;
+    std::vector<static_batch> tiles; // tile (kx,ky) stored at kx+N*ky
+};
+
+// Apply the transformation (scaling, rotation then translation) to the positions and normals of a mesh
+vcl::mesh transform_mesh(vcl::mesh shape, vcl::affine_rts const& transform);
@@ -1,5 +1,10 @@
 
 #include "terrain.hpp"
+#include "heightfield.hpp"
+#include "parallel.hpp"
+#include "noise_simd.hpp"
+
+#include <cmath>
 
 using namespace vcl;
 using namespace std;
@@ -8,6 +13,12 @@ perlin_noise_parameters parameters;
 
 // Evaluate 3D position of the terrain for any (u,v) \in [0,1]
 vec3 evaluate_terrain(float u, float v)
+{
+    return evaluate_terrain(u, v, parameters);
+}
+
+// Terrain point from the noise at (u,v): the noise is scaled and 4 gaussian bumps are added
+static vec3 terrain_point(float u, float v, float noise, perlin_noise_parameters const& parameters)
 {
     float const x = 20*(u-0.5f);
     float const y = 20*(v-0.5f);
@@ -16,74 +27,167 @@ vec3 evaluate_terrain(float u, float v)
     vcl::buffer_stack<float, 4> const h = {1.5,-0.5,0.9,1.5};
     vcl::buffer_stack<float, 4> const sigma = {0.2,0.3,0.1,0.2};
 
-    float z = 0;
+    float z = 4*parameters.terrain_height*noise;
 
     for (int n=3; n>=0; n--)
       {
         float d = norm(vec2(u,v)-p[n])/sigma[n];
         z += h[n]*std::exp(-d*d);
-
-        // Compute the Perlin noise
-        float const noise = noise_perlin({u, v}, parameters.octave, parameters.persistency, parameters.frequency_gain);
-        z += parameters.terrain_height*noise;
       }
     return {x,y,z};
 }
 
+vec3 evaluate_terrain(float u, float v, perlin_noise_parameters const& parameters)
+{
+    float const noise = noise_perlin({u, v}, parameters.octave, parameters.persistency, parameters.frequency_gain);
+    return terrain_point(u, v, noise, parameters);
+}
+
+void evaluate_terrain_row(float u, float const* v, size_t N, perlin_noise_parameters const& parameters, vec3* positions)
+{
+    thread_local std::vector<float> noise;
+    noise.resize(N);
+    noise_perlin_row(u, v, N, noise.data(), parameters.octave, parameters.persistency, parameters.frequency_gain);
+    for(size_t k=0; k<N; ++k)
+        positions[k] = terrain_point(u, v[k], noise[k], parameters);
+}
+
+void evaluate_terrain_grid_row(unsigned int ku, unsigned int N, perlin_noise_parameters const& parameters, vec3* positions)
+{
+    thread_local std::vector<float> v;
+    v.resize(N);
+    for(unsigned int kv=0; kv<N; ++kv)
+        v[kv] = kv/(N-1.0f);
+    evaluate_terrain_row(ku/(N-1.0f), v.data(), N, parameters, positions);
+}
+
+// Normals of a row of the grid from central differences with the previous and next rows
+//  On the border of the grid, previous or next is the row itself (one-sided differences)
+static void compute_row_normals(vec3 const* previous, vec3 const* current, vec3 const* next, unsigned int N, vec3* normals)
+{
+    for(unsigned int kv=0; kv<N; ++kv)
+    {
+        unsigned int const kv0 = kv>0 ? kv-1 : kv;
+        unsigned int const kv1 = kv<N-1 ? kv+1 : kv;
+        vec3 const dpdu = next[kv]-previous[kv];
+        vec3 const dpdv = current[kv1]-current[kv0];
+        normals[kv] = normalize(cross(dpdu,dpdv));
+    }
+}
 
-mesh create_terrain()
+mesh create_terrain(unsigned int N)
 {
     // Number of samples of the terrain is N x N
-    const unsigned int N = 100;
 
     mesh terrain; // temporary terrain storage (CPU only)
     terrain.position.resize(N*N);
+    terrain.normal.resize(N*N);
     terrain.uv.resize(N*N);
-
-    // Fill terrain geometry
-    for(unsigned int ku=0; ku<N; ++ku)
-    {
-        for(unsigned int kv=0; kv<N; ++kv)
+    terrain.connectivity.resize(2*(N-1)*(N-1));
+
+    // Each block of rows is filled by one thread: positions, uv, triangles and normals.
+    //  The normals of the first and last rows of a block need the neighboring rows, evaluated again by the block
+    parallel_for(0, N, [&](size_t b, size_t e) {
+        std::vector<vec3> row_before(N), row_after(N);
+        if(b>0)
+            evaluate_terrain_grid_row(unsigned(b-1), N, parameters, row_before.data());
+        if(e<N)
+            evaluate_terrain_grid_row(unsigned(e), N, parameters, row_after.data());
+
+        for(size_t ku=b; ku<e; ++ku)
         {
-            // Compute local parametric coordinates (u,v) \in [0,1]
-            const float u = ku/(N-1.0f);
-            const float v = kv/(N-1.0f);
-
-            // Compute the local surface function
-            vec3 const p = evaluate_terrain(u,v);
-
-            // Store vertex coordinates
-            terrain.position[kv+N*ku] = p;
-            terrain.uv[kv+N*ku] = {10*u,10*v};
+            evaluate_terrain_grid_row(unsigned(ku), N, parameters, &terrain.position[N*ku]);
+            for(unsigned int kv=0; kv<N; ++kv)
+            {
+                // Compute local parametric coordinates (u,v) \in [0,1]
+                const float u = ku/(N-1.0f);
+                const float v = kv/(N-1.0f);
+                terrain.uv[kv+N*ku] = {10*u,10*v};
+            }
+
+            // Parametric surface with uniform grid sampling: 2 triangles for each grid cell
+            if(ku<N-1)
+            {
+                for(unsigned int kv=0; kv<N-1; ++kv)
+                {
+                    const unsigned int idx = kv + N*unsigned(ku); // current vertex offset
+                    terrain.connectivity[2*(kv+(N-1)*ku)] = {idx, idx+1+N, idx+1};
+                    terrain.connectivity[2*(kv+(N-1)*ku)+1] = {idx, idx+N, idx+1+N};
+                }
+            }
         }
-    }
 
-    // Generate triangle organization
-    //  Parametric surface with uniform grid sampling: generate 2 triangles for each grid cell
-    for(size_t ku=0; ku<N-1; ++ku)
-    {
-        for(size_t kv=0; kv<N-1; ++kv)
+        for(size_t ku=b; ku<e; ++ku)
         {
-            const unsigned int idx = kv + N*ku; // current vertex offset
+            vec3 const* current = &terrain.position[N*ku];
+            vec3 const* previous = ku==0 ? current : ku==b ? row_before.data() : current-N;
+            vec3 const* next = ku==N-1 ? current : ku+1==e ? row_after.data() : current+N;
+            compute_row_normals(previous, current, next, N, &terrain.normal[N*ku]);
+        }
+    });
 
-            const uint3 triangle_1 = {idx, idx+1+N, idx+1};
-            const uint3 triangle_2 = {idx, idx+N, idx+1+N};
+	terrain.fill_empty_field(); // need to call this function to fill the other buffer with default values (color)
+    return terrain;
+}
 
-            terrain.connectivity.push_back(triangle_1);
-            terrain.connectivity.push_back(triangle_2);
-        }
+// Normals of the rows [ku_begin,ku_end[ from central differences of the grid positions
+static void compute_terrain_normals(mesh& terrain, unsigned int N, unsigned int ku_begin, unsigned int ku_end)
+{
+    for(unsigned int ku=ku_begin; ku<ku_end; ++ku)
+    {
+        unsigned int const ku0 = ku>0 ? ku-1 : ku;
+        unsigned int const ku1 = ku<N-1 ? ku+1 : ku;
+        compute_row_normals(&terrain.position[N*ku0], &terrain.position[N*ku], &terrain.position[N*ku1], N, &terrain.normal[N*ku]);
     }
+}
 
-	terrain.fill_empty_field(); // need to call this function to fill the other buffer with default values (normal, color, etc)
-    return terrain;
+// Upload the vertices [k_begin,k_end[ of a buffer into an existing VBO
+static void upload_vertex_range(GLuint vbo, buffer<vec3> const& data, size_t k_begin, size_t k_end)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, GLintptr(k_begin*sizeof(vec3)), GLsizeiptr((k_end-k_begin)*sizeof(vec3)), &data[k_begin]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void update_terrain(mesh& terrain, mesh_drawable& terrain_visual, perlin_noise_parameters const& parameters)
+{
+    unsigned int const N = static_cast<unsigned int>(std::lround(std::sqrt(terrain.position.size())));
+    update_terrain(terrain, terrain_visual, parameters, 0, N);
+}
+
+void update_terrain(mesh& terrain, mesh_drawable& terrain_visual, perlin_noise_parameters const& parameters, unsigned int ku_begin, unsigned int ku_end)
+{
+    // Number of samples in each direction (square grid)
+    unsigned int const N = static_cast<unsigned int>(std::lround(std::sqrt(terrain.position.size())));
+    assert_vcl(N*N==terrain.position.size(), "update_terrain expects a N x N terrain built by create_terrain");
+    ku_end = std::min(ku_end, N);
+    if(ku_begin>=ku_end)
+        return;
+
+    // Recompute the positions of the rows, split across the threads
+    parallel_for(ku_begin, ku_end, [&](size_t b, size_t e) {
+        for(size_t ku=b; ku<e; ++ku)
+            evaluate_terrain_grid_row(unsigned(ku), N, parameters, &terrain.position[N*ku]);
+    });
+
+    // The normals of the neighboring rows depend on the updated positions
+    unsigned int const kn_begin = ku_begin>0 ? ku_begin-1 : 0;
+    unsigned int const kn_end = std::min(ku_end+1, N);
+    parallel_for(kn_begin, kn_end, [&](size_t b, size_t e) {
+        compute_terrain_normals(terrain, N, unsigned(b), unsigned(e));
+    });
+
+    // Only send the modified vertices to the GPU
+    upload_vertex_range(terrain_visual.vbo.at("position"), terrain.position, size_t(N)*ku_begin, size_t(N)*ku_end);
+    upload_vertex_range(terrain_visual.vbo.at("normal"), terrain.normal, size_t(N)*kn_begin, size_t(N)*kn_end);
 }
 
-std::vector<vcl::vec3> generate_positions_on_terrain(int N){
+std::vector<vcl::vec3> generate_positions_on_terrain(int N, heightfield const& field){
 
     std::vector<vcl::vec3> pos;
 
     for (int k=0; k<N; k++){
-        pos.push_back(vec3(evaluate_terrain(rand_interval(0.05,0.95),rand_interval(0.05,0.95))) + vec3(0,0,-0.05));
+        pos.push_back(field.position(rand_interval(0.05,0.95),rand_interval(0.05,0.95)) + vec3(0,0,-0.05));
     }
     return pos;
 }
@@ -10,9 +10,23 @@ struct perlin_noise_parameters
         float terrain_height = 0.25f;
 };
 
+// Parameters currently used to generate the terrain
+extern perlin_noise_parameters parameters;
+
 vcl::vec3 evaluate_terrain(float u, float v);
-vcl::mesh create_terrain();
+vcl::vec3 evaluate_terrain(float u, float v, perlin_noise_parameters const& parameters);
+// Positions of the samples (u, v[k]) for k \in [0,N[: the noise of the whole row is evaluated at once (see noise_simd.hpp)
+void evaluate_terrain_row(float u, float const* v, size_t N, perlin_noise_parameters const& parameters, vcl::vec3* positions);
+// Row ku of a N x N grid over [0,1]^2: positions[kv] = evaluate_terrain(ku/(N-1), kv/(N-1))
+void evaluate_terrain_grid_row(unsigned int ku, unsigned int N, perlin_noise_parameters const& parameters, vcl::vec3* positions);
+vcl::mesh create_terrain(unsigned int N = 100);
+// Revision of evaluate_terrain and create_terrain, added to the keys of the cached terrain and heightfield: increment it at each change
+int const terrain_revision = 1;
 
-std::vector<vcl::vec3> generate_positions_on_terrain(int N);
+struct heightfield;
+std::vector<vcl::vec3> generate_positions_on_terrain(int N, heightfield const& field);
 
+// Recompute the positions and normals of a terrain created by create_terrain() and upload them in the existing buffers
+//  The connectivity is reused. The second version only updates the rows ku \in [ku_begin,ku_end[
 void update_terrain(vcl::mesh& terrain, vcl::mesh_drawable& terrain_visual, perlin_noise_parameters const& parameters);
+void update_terrain(vcl::mesh& terrain, vcl::mesh_drawable& terrain_visual, perlin_noise_parameters const& parameters, unsigned int ku_begin, unsigned int ku_end);
@@ -0,0 +1,224 @@
+#include "terrain_chunks.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vcl;
+
+mesh create_terrain_chunk(int i, int j, unsigned int N, float skirt_depth, perlin_noise_parameters const& parameters)
+{
+    unsigned int const M = N+1;  // vertices per side
+    unsigned int const R = M+2;  // samples per side, with one more ring around the chunk
+
+    // Samples of the terrain, the ring is only used by the normals
+    std::vector<vec3> samples(R*R);
+    std::vector<float> v(R);
+    for(unsigned int b=0; b<R; ++b)
+        v[b] = j + (int(b)-1)/float(N);
+    for(unsigned int a=0; a<R; ++a)
+        evaluate_terrain_row(i + (int(a)-1)/float(N), v.data(), R, parameters, &samples[R*a]);
+
+    mesh terrain;
+    terrain.position.resize(M*M);
+    terrain.normal.resize(M*M);
+    terrain.uv.resize(M*M);
+    for(unsigned int ku=0; ku<M; ++ku) {
+        for(unsigned int kv=0; kv<M; ++kv) {
+            unsigned int const s = (kv+1)+R*(ku+1);
+            vec3 const dpdu = samples[s+R]-samples[s-R];
+            vec3 const dpdv = samples[s+1]-samples[s-1];
+            terrain.position[kv+M*ku] = samples[s];
+            terrain.normal[kv+M*ku] = normalize(cross(dpdu,dpdv));
+            terrain.uv[kv+M*ku] = {10*(i+ku/float(N)), 10*(j+kv/float(N))}; // same texture coordinates as create_terrain()
+        }
+    }
+
+    // Same triangles as create_terrain()
+    for(unsigned int ku=0; ku<N; ++ku) {
+        for(unsigned int kv=0; kv<N; ++kv) {
+            unsigned int const idx = kv + M*ku;
+            terrain.connectivity.push_back({idx, idx+1+M, idx+1});
+            terrain.connectivity.push_back({idx, idx+M, idx+1+M});
+        }
+    }
+
+    // Skirts: copy of each border moved down, linked to the border by a strip of triangles
+    for(int side=0; side<4; ++side) {
+        unsigned int const first_skirt = static_cast<unsigned int>(terrain.position.size());
+        for(unsigned int k=0; k<M; ++k) {
+            unsigned int const idx = side==0 ? k : side==1 ? k+M*N : side==2 ? M*k : N+M*k;
+            terrain.position.push_back(terrain.position[idx] - vec3(0,0,skirt_depth));
+            terrain.normal.push_back(terrain.normal[idx]);
+            terrain.uv.push_back(terrain.uv[idx]);
+        }
+        for(unsigned int k=0; k<N; ++k) {
+            unsigned int const a = side==0 ? k : side==1 ? k+M*N : side==2 ? M*k : N+M*k;
+            unsigned int const b = side==0 ? k+1 : side==1 ? k+1+M*N : side==2 ? M*(k+1) : N+M*(k+1);
+            terrain.connectivity.push_back({a, b, first_skirt+k+1});
+            terrain.connectivity.push_back({a, first_skirt+k+1, first_skirt+k});
+        }
+    }
+
+    terrain.fill_empty_field();
+    return terrain;
+}
+
+bool terrain_chunks::chunk_key::operator<(chunk_key const& k) const
+{
+    if(i!=k.i) return i<k.i;
+    if(j!=k.j) return j<k.j;
+    return level<k.level;
+}
+
+void terrain_chunks::initialize(mesh_drawable const& material_arg, perlin_noise_parameters const& parameters, unsigned int N_thread)
+{
+    material = material_arg;
+    noise = parameters;
+    pool.reset(new thread_pool(N_thread));
+}
+
+void terrain_chunks::invalidate(perlin_noise_parameters const& parameters)
+{
+    noise = parameters;
+    ++generation;
+    while(!chunks.empty())
+        remove(chunks.begin());
+    pending.clear();
+    drawn.clear();
+}
+
+void terrain_chunks::update(vec3 const& camera_position, frustum const& view)
+{
+    receive();
+    ++frame;
+    drawn.clear();
+
+    // Chunk below the camera: chunk (i,j) covers x \in [(i-1/2) L, (i+1/2) L]
+    float const L = chunk_parameters.chunk_size;
+    int const ci = int(std::floor(camera_position.x/L + 0.5f));
+    int const cj = int(std::floor(camera_position.y/L + 0.5f));
+    int const R = chunk_parameters.view_radius;
+
+    std::vector<std::pair<float, chunk_key>> missing;
+    for(int i=ci-R; i<=ci+R; ++i) {
+        for(int j=cj-R; j<=cj+R; ++j) {
+            if(chunk_parameters.skip_origin && i==0 && j==0)
+                continue;
+
+            vec3 const center = {i*L, j*L, 0.0f};
+            float const radius = 0.71f*L + chunk_parameters.height_bound + chunk_parameters.skirt_depth;
+            if(!view.intersect({center, radius}))
+                continue;
+
+            float const d = std::max(0.0f, norm(vec2(center.x-camera_position.x, center.y-camera_position.y)) - 0.71f*L);
+            int level = 0;
+            while(level<chunk_parameters.levels-1 && d>chunk_parameters.lod_distance*(1<<level))
+                ++level;
+
+            chunk_key const key = {i, j, level};
+            auto it = chunks.find(key);
+            if(it==chunks.end()) {
+                missing.push_back({d, key});
+
+                // Meanwhile, draw the closest resident level
+                for(int delta=1; delta<chunk_parameters.levels && it==chunks.end(); ++delta) {
+                    it = chunks.find({i, j, level+delta});
+                    if(it==chunks.end())
+                        it = chunks.find({i, j, level-delta});
+                }
+                if(it==chunks.end())
+                    continue;
+            }
+            it->second.last_used = frame;
+            drawn.push_back(it->first);
+        }
+    }
+
+    // The closest chunks are requested first
+    std::sort(missing.begin(), missing.end(), [](std::pair<float, chunk_key> const& a, std::pair<float, chunk_key> const& b){ return a.first<b.first; });
+    for(auto const& m : missing) {
+        if(pending.size()>=chunk_parameters.max_pending)
+            break;
+        request(m.second);
+    }
+
+    evict();
+}
+
+void terrain_chunks::receive()
+{
+    std::vector<chunk_result> received;
+    {
+        std::lock_guard<std::mutex> lock(results_mutex);
+        received.swap(results);
+    }
+
+    // Send the meshes to the GPU (main thread only)
+    for(chunk_result const& result : received) {
+        if(result.generation!=generation)
+            continue;
+        pending.erase(result.key);
+
+        chunk c;
+        c.drawable = mesh_drawable(result.terrain, material.shader, material.texture);
+        c.drawable.shading = material.shading;
+        // position, normal, color (vec3), uv (vec2) and indices
+        c.bytes = result.terrain.position.size()*(3*sizeof(vec3)+sizeof(vec2)) + result.terrain.connectivity.size()*sizeof(uint3);
+        c.last_used = frame;
+        memory_used += c.bytes;
+        chunks[result.key] = c;
+    }
+}
+
+void terrain_chunks::request(chunk_key const& key)
+{
+    if(!pool || pending.count(key))
+        return;
+    pending.insert(key);
+
+    unsigned int const N = std::max(1u, chunk_parameters.resolution >> key.level);
+    float const skirt_depth = chunk_parameters.skirt_depth;
+    perlin_noise_parameters const parameters = noise;
+    unsigned int const current_generation = generation;
+    pool->submit([this, key, N, skirt_depth, parameters, current_generation]() {
+        chunk_result result = {key, current_generation, create_terrain_chunk(key.i, key.j, N, skirt_depth, parameters)};
+        std::lock_guard<std::mutex> lock(results_mutex);
+        results.push_back(std::move(result));
+    });
+}
+
+void terrain_chunks::evict()
+{
+    // Remove the least recently used chunks, never the ones drawn in this frame
+    while(memory_used>chunk_parameters.memory_budget) {
+        auto oldest = chunks.end();
+        for(auto it=chunks.begin(); it!=chunks.end(); ++it)
+            if(it->second.last_used<frame && (oldest==chunks.end() || it->second.last_used<oldest->second.last_used))
+                oldest = it;
+        if(oldest==chunks.end())
+            return;
+        remove(oldest);
+    }
+}
+
+void terrain_chunks::remove(std::map<chunk_key, chunk>::iterator it)
+{
+    memory_used -= it->second.bytes;
+    it->second.drawable.clear();
+    chunks.erase(it);
+}
+
+size_t terrain_chunks::memory() const
+{
+    return memory_used;
+}
+
+size_t terrain_chunks::resident() const
+{
+    return chunks.size();
+}
+
+size_t terrain_chunks::visible() const
+{
+    return drawn.size();
+}
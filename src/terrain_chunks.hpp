@@ -0,0 +1,98 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+#include "terrain.hpp"
+#include "culling.hpp"
+#include "thread_pool.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+/** Mesh of the chunk (i,j) of the terrain, covering (u,v) \in [i,i+1]x[j,j+1] of evaluate_terrain()
+*  - The chunk (0,0) is the [-10,10]^2 domain of create_terrain()
+*  - N cells per side, the normals are computed from an extra ring of samples to be continuous between chunks
+*  - Each border is extended by a vertical skirt of depth skirt_depth hiding the cracks between chunks of different resolutions */
+vcl::mesh create_terrain_chunk(int i, int j, unsigned int N, float skirt_depth, perlin_noise_parameters const& parameters);
+
+struct terrain_chunk_parameters
+{
+    float chunk_size = 20.0f;         // world size of a chunk (one unit of (u,v))
+    unsigned int resolution = 64;     // cells per side of the finest level, halved at each coarser level
+    int levels = 4;
+    float lod_distance = 40.0f;       // level l is used up to a distance lod_distance*2^l of the chunk
+    int view_radius = 6;              // chunks loaded in a square of (2*view_radius+1)^2 chunks around the camera
+    size_t memory_budget = 64u<<20;   // GPU memory (bytes) of the resident chunks before eviction
+    size_t max_pending = 8;           // chunks generated at the same time
+    float skirt_depth = 1.0f;
+    float height_bound = 10.0f;       // bound of |z| used for the bounding sphere of a chunk not generated yet
+    bool skip_origin = true;          // the chunk (0,0) is drawn separately by the detailed terrain of the scene
+};
+
+/** Terrain streamed around the camera by chunks
+*  - The missing chunks are generated on a thread pool, the meshes are sent to the GPU on the main thread in update()
+*  - The level of each chunk depends on its distance to the camera. A resident level is drawn while the wanted one is generated
+*  - The least recently used chunks are evicted when the GPU memory exceeds the budget */
+struct terrain_chunks
+{
+    // material: shader, texture and shading used by the chunks
+    void initialize(vcl::mesh_drawable const& material, perlin_noise_parameters const& parameters, unsigned int N_thread = 0);
+    // Remove every chunk: they are generated again with the new parameters
+    void invalidate(perlin_noise_parameters const& parameters);
+    // Receive the generated chunks, select the chunks to draw and request the missing ones
+    void update(vcl::vec3 const& camera_position, frustum const& view);
+
+    size_t memory() const;    // GPU memory of the resident chunks (bytes)
+    size_t resident() const;  // number of resident chunks (all levels)
+    size_t visible() const;   // number of chunks drawn at the last update
+
+    terrain_chunk_parameters chunk_parameters;
+
+    struct chunk_key
+    {
+        int i, j, level;
+        bool operator<(chunk_key const& k) const;
+    };
+    struct chunk
+    {
+        vcl::mesh_drawable drawable;
+        size_t bytes = 0;
+        size_t last_used = 0; // frame of the last draw
+    };
+    struct chunk_result
+    {
+        chunk_key key;
+        unsigned int generation;
+        vcl::mesh terrain;
+    };
+
+    std::map<chunk_key, chunk> chunks;
+    std::vector<chunk_key> drawn;
+
+private:
+    void receive();
+    void request(chunk_key const& key);
+    void evict();
+    void remove(std::map<chunk_key, chunk>::iterator it);
+
+    vcl::mesh_drawable material;
+    perlin_noise_parameters noise;
+    unsigned int generation = 0; // incremented by invalidate(): results of older generations are discarded
+    size_t frame = 0;
+    size_t memory_used = 0;
+    std::set<chunk_key> pending;
+
+    std::mutex results_mutex;
+    std::vector<chunk_result> results;
+
+    std::unique_ptr<thread_pool> pool; // last member: the workers are stopped before the results are destroyed
+};
+
+template <typename SCENE>
+void draw(terrain_chunks const& terrain, SCENE const& scene)
+{
+    for(terrain_chunks::chunk_key const& key : terrain.drawn)
+        draw(terrain.chunks.at(key).drawable, scene);
+}
@@ -0,0 +1,289 @@
+#include "texture_pipeline.hpp"
+#include "mapped_file.hpp"
+#include "mesh_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+using namespace vcl;
+
+// RGBA pixels of an image (the alpha of a RGB image is opaque)
+static texture_level rgba_level(image_raw const& image)
+{
+    texture_level level;
+    level.width = image.width;
+    level.height = image.height;
+    size_t const N = size_t(image.width)*image.height;
+    level.data.resize(4*N);
+    if(image.color_type==image_color_type::rgba) {
+        std::memcpy(level.data.data(), &image.data[0], 4*N);
+        return level;
+    }
+    for(size_t k=0; k<N; ++k) {
+        level.data[4*k+0] = image.data[3*k+0];
+        level.data[4*k+1] = image.data[3*k+1];
+        level.data[4*k+2] = image.data[3*k+2];
+        level.data[4*k+3] = 255;
+    }
+    return level;
+}
+
+// Next level: average of 2x2 pixels (the last row/column is repeated for odd sizes)
+static texture_level half_level(texture_level const& level)
+{
+    texture_level half;
+    half.width = std::max(1u, level.width/2);
+    half.height = std::max(1u, level.height/2);
+    half.data.resize(4*size_t(half.width)*half.height);
+    for(unsigned int j=0; j<half.height; ++j) {
+        unsigned int const j0 = std::min(2*j, level.height-1), j1 = std::min(2*j+1, level.height-1);
+        for(unsigned int i=0; i<half.width; ++i) {
+            unsigned int const i0 = std::min(2*i, level.width-1), i1 = std::min(2*i+1, level.width-1);
+            for(int c=0; c<4; ++c) {
+                unsigned int const sum = level.data[4*(i0+level.width*j0)+c] + level.data[4*(i1+level.width*j0)+c]
+                                       + level.data[4*(i0+level.width*j1)+c] + level.data[4*(i1+level.width*j1)+c];
+                half.data[4*(i+half.width*j)+c] = static_cast<unsigned char>((sum+2)/4);
+            }
+        }
+    }
+    return half;
+}
+
+static texture_image mipmaps_of_level(texture_level const& level, unsigned int max_levels)
+{
+    texture_image image;
+    image.levels.push_back(level);
+    while(max_levels==0 || image.levels.size()<max_levels) {
+        texture_level const& last = image.levels.back();
+        if(last.width==1 && last.height==1)
+            break;
+        image.levels.push_back(half_level(last));
+    }
+    return image;
+}
+
+texture_image create_mipmaps(image_raw const& image, unsigned int max_levels)
+{
+    return mipmaps_of_level(rgba_level(image), max_levels);
+}
+
+// Cache file: one block with the sizes of the levels, then one block of pixels per level
+static bool load_texture_cache(std::string const& path, cache_key const& key, texture_image& image)
+{
+    cache_file file;
+    if(!file.open(path, key) || file.size()<2)
+        return false;
+    size_t bytes = 0;
+    char const* sizes = file.block(0, bytes);
+    if(bytes!=2*sizeof(uint32_t)*(file.size()-1))
+        return false;
+
+    texture_image loaded;
+    loaded.levels.resize(file.size()-1);
+    for(size_t k=0; k<loaded.levels.size(); ++k) {
+        uint32_t size[2];
+        std::memcpy(size, sizes+2*sizeof(uint32_t)*k, sizeof(size));
+        texture_level& level = loaded.levels[k];
+        level.width = size[0];
+        level.height = size[1];
+        char const* pixels = file.block(k+1, bytes);
+        if(bytes!=4*size_t(level.width)*level.height)
+            return false;
+        level.data.assign(pixels, pixels+bytes);
+    }
+    image = std::move(loaded);
+    return true;
+}
+
+static bool save_texture_cache(std::string const& path, cache_key const& key, texture_image const& image)
+{
+    if(!create_directory(cache_directory))
+        return false;
+    std::vector<uint32_t> sizes;
+    std::vector<cache_block> blocks(1);
+    for(texture_level const& level : image.levels) {
+        sizes.push_back(level.width);
+        sizes.push_back(level.height);
+        blocks.push_back({level.data.data(), level.data.size()});
+    }
+    blocks[0] = {sizes.data(), sizes.size()*sizeof(uint32_t)};
+    return write_cache_file(path, key, blocks);
+}
+
+// Revision of create_mipmaps: increment it at each change of the filter, the cached mip chains are then built again
+static int const mipmap_revision = 1;
+
+// Key of a PNG file: hash of its content and of the revision of the mip chain
+static bool png_key(std::string const& png_path, cache_key& key)
+{
+    mapped_file file;
+    if(!file.open(png_path))
+        return false;
+    key.add(mipmap_revision);
+    key.add(file.data(), file.size());
+    return true;
+}
+
+// Name of a cache file from the path of a texture (without directories)
+static std::string cache_name(std::string const& png_path)
+{
+    std::string name = png_path;
+    std::replace(name.begin(), name.end(), '/', '_');
+    std::replace(name.begin(), name.end(), '\\', '_');
+    return "texture-" + name;
+}
+
+texture_image load_texture_image(std::string const& png_path)
+{
+    cache_key key;
+    if(!png_key(png_path, key))
+        return create_mipmaps(image_load_png(png_path)); // reports the missing file
+
+    std::string const path = cache_path(cache_name(png_path), key);
+    texture_image image;
+    if(load_texture_cache(path, key, image))
+        return image;
+
+    image = create_mipmaps(image_load_png(png_path));
+    save_texture_cache(path, key, image);
+    return image;
+}
+
+void opengl_texture_update(GLuint texture, texture_image const& image, GLint wrap_s, GLint wrap_t)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(size_t k=0; k<image.levels.size(); ++k) {
+        texture_level const& level = image.levels[k];
+        glTexImage2D(GL_TEXTURE_2D, GLint(k), GL_RGBA8, GLsizei(level.width), GLsizei(level.height), 0, GL_RGBA, GL_UNSIGNED_BYTE, level.data.data());
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(image.levels.size())-1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image.levels.size()>1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    opengl_check;
+}
+
+bool png_size(std::string const& png_path, unsigned int& width, unsigned int& height)
+{
+    // Signature (8 bytes), length and type of the IHDR chunk (8 bytes), then width and height in big endian
+    std::ifstream in(png_path, std::ios::binary);
+    unsigned char header[24];
+    if(!in.read(reinterpret_cast<char*>(header), sizeof(header)) || std::memcmp(header+12, "IHDR", 4)!=0)
+        return false;
+    width = (unsigned(header[16])<<24) | (unsigned(header[17])<<16) | (unsigned(header[18])<<8) | unsigned(header[19]);
+    height = (unsigned(header[20])<<24) | (unsigned(header[21])<<16) | (unsigned(header[22])<<8) | unsigned(header[23]);
+    return true;
+}
+
+vec2 atlas_region::remap(vec2 const& uv) const
+{
+    return {uv_min.x + uv.x*(uv_max.x-uv_min.x), uv_min.y + uv.y*(uv_max.y-uv_min.y)};
+}
+
+void texture_atlas::layout(std::vector<std::string> const& png_paths, unsigned int padding_arg)
+{
+    paths = png_paths;
+    padding = padding_arg;
+    size_t const N = paths.size();
+    image_width.assign(N, 1);
+    image_height.assign(N, 1);
+    for(size_t k=0; k<N; ++k)
+        png_size(paths[k], image_width[k], image_height[k]);
+
+    // Shelves of images sorted by decreasing height, in a square of power of 2 width large enough for the total area
+    std::vector<size_t> order(N);
+    size_t area = 0;
+    unsigned int widest = 1;
+    for(size_t k=0; k<N; ++k) {
+        order[k] = k;
+        area += size_t(image_width[k]+2*padding)*(image_height[k]+2*padding);
+        widest = std::max(widest, image_width[k]+2*padding);
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b){ return image_height[a]>image_height[b]; });
+    width = 1;
+    while(size_t(width)*width<area || width<widest)
+        width *= 2;
+
+    x.assign(N, 0);
+    y.assign(N, 0);
+    unsigned int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+    for(size_t k : order) {
+        unsigned int const w = image_width[k]+2*padding, h = image_height[k]+2*padding;
+        if(shelf_x+w>width) {
+            shelf_y += shelf_height;
+            shelf_x = 0;
+            shelf_height = 0;
+        }
+        x[k] = shelf_x + padding;
+        y[k] = shelf_y + padding;
+        shelf_x += w;
+        shelf_height = std::max(shelf_height, h);
+    }
+    height = 1;
+    while(height<shelf_y+shelf_height)
+        height *= 2;
+
+    regions.clear();
+    for(size_t k=0; k<N; ++k)
+        regions[paths[k]] = {{x[k]/float(width), y[k]/float(height)}, {(x[k]+image_width[k])/float(width), (y[k]+image_height[k])/float(height)}};
+}
+
+texture_image texture_atlas::compose() const
+{
+    // The atlas is cached with the content of all its images and its layout
+    cache_key key;
+    key.add(width).add(height).add(padding);
+    for(std::string const& path : paths)
+        png_key(path, key);
+    std::string const path = cache_path("atlas", key);
+    texture_image atlas;
+    if(load_texture_cache(path, key, atlas))
+        return atlas;
+
+    texture_level level;
+    level.width = width;
+    level.height = height;
+    level.data.assign(4*size_t(width)*height, 0);
+    for(size_t k=0; k<paths.size(); ++k) {
+        texture_level const image = rgba_level(image_load_png(paths[k]));
+        if(image.width!=image_width[k] || image.height!=image_height[k])
+            continue; // the file changed since the layout
+        // Copy the image and extend its border over the padding
+        int const p = int(padding);
+        for(int j=-p; j<int(image.height)+p; ++j) {
+            unsigned int const sj = unsigned(std::min(std::max(j, 0), int(image.height)-1));
+            for(int i=-p; i<int(image.width)+p; ++i) {
+                unsigned int const si = unsigned(std::min(std::max(i, 0), int(image.width)-1));
+                std::memcpy(&level.data[4*((x[k]+i)+size_t(width)*(y[k]+j))], &image.data[4*(si+size_t(image.width)*sj)], 4);
+            }
+        }
+    }
+
+    // Stop the chain when the padding vanishes, so that the images do not mix
+    unsigned int max_levels = 1;
+    for(unsigned int p=padding; p>1; p/=2)
+        ++max_levels;
+    atlas = mipmaps_of_level(level, max_levels);
+    save_texture_cache(path, key, atlas);
+    return atlas;
+}
+
+atlas_region const& texture_atlas::region(std::string const& png_path) const
+{
+    return regions.at(png_path);
+}
+
+bool remap_uv(mesh& shape, atlas_region const& region)
+{
+    for(size_t k=0; k<shape.uv.size(); ++k)
+        if(shape.uv[k].x<0 || shape.uv[k].x>1 || shape.uv[k].y<0 || shape.uv[k].y>1)
+            return false;
+    for(size_t k=0; k<shape.uv.size(); ++k)
+        shape.uv[k] = region.remap(shape.uv[k]);
+    return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "vcl/vcl.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+/** Pre-decoded textures with their mip chains
+*  - The chain is computed once (box filter) and stored with the decoded pixels in cache/, keyed by a hash of the PNG file:
+*     the next runs read it through a memory mapping without decoding the PNG file
+*  - All the levels are RGBA 8 bits */
+struct texture_level
+{
+    unsigned int width = 0, height = 0;
+    std::vector<unsigned char> data; // width*height RGBA pixels
+};
+
+struct texture_image
+{
+    std::vector<texture_level> levels; // levels[0] is the full resolution image
+};
+
+// Mip chain of an image, down to 1x1 or limited to max_levels levels (0: no limit)
+texture_image create_mipmaps(vcl::image_raw const& image, unsigned int max_levels = 0);
+// Image and mip chain of a PNG file, read from the cache when the file did not change
+texture_image load_texture_image(std::string const& png_path);
+
+// Fill an existing texture object with all the levels of a texture
+void opengl_texture_update(GLuint texture, texture_image const& image, GLint wrap_s, GLint wrap_t);
+
+// Width and height of a PNG file read from its header, without decoding the image
+bool png_size(std::string const& png_path, unsigned int& width, unsigned int& height);
+
+// Part of an atlas where a texture is stored
+struct atlas_region
+{
+    vcl::vec2 uv_min, uv_max;
+    vcl::vec2 remap(vcl::vec2 const& uv) const; // texture coordinates \in [0,1] of the texture to coordinates in the atlas
+};
+
+/** Small textures packed in a single one
+*  - The layout only needs the size of the images (read in the PNG headers): the regions are known before the pixels are loaded
+*  - Each image is surrounded by padding pixels copying its border, so that the filtering and the first mip levels do not mix neighbor images */
+struct texture_atlas
+{
+    // Compute the regions of the images (rows of images sorted by height)
+    void layout(std::vector<std::string> const& png_paths, unsigned int padding = 8);
+    // Decode the images and build the atlas with its mip chain (can run on any thread), cached as the other textures
+    texture_image compose() const;
+    atlas_region const& region(std::string const& png_path) const;
+
+    unsigned int width = 0, height = 0;
+    unsigned int padding = 0;
+    std::vector<std::string> paths;
+    std::vector<unsigned int> x, y; // corner of each image in the atlas (pixels)
+    std::vector<unsigned int> image_width, image_height;
+    std::map<std::string, atlas_region> regions;
+};
+
+// Texture coordinates of a mesh remapped to a region of an atlas
+//  Return false (mesh unchanged) if a coordinate is outside [0,1]: a repeated texture cannot be stored in an atlas
+bool remap_uv(vcl::mesh& shape, atlas_region const& region);
@@ -0,0 +1,60 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+thread_pool::thread_pool(unsigned int N_thread)
+{
+    if(N_thread==0)
+        N_thread = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    workers.reserve(N_thread);
+    for(unsigned int k=0; k<N_thread; ++k)
+        workers.emplace_back([this](){ run(); });
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+        tasks.clear();
+    }
+    condition.notify_all();
+    for(std::thread& worker : workers)
+        worker.join();
+}
+
+void thread_pool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    condition.notify_one();
+}
+
+size_t thread_pool::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return tasks.size();
+}
+
+size_t thread_pool::size() const
+{
+    return workers.size();
+}
+
+void thread_pool::run()
+{
+    for(;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this](){ return stop || !tasks.empty(); });
+            if(stop)
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Fixed set of worker threads running the submitted tasks in submission order
+*  - Used for the background work that spans several frames (ex. generation of terrain chunks)
+*  - The destructor waits for the running tasks and discards the pending ones */
+struct thread_pool
+{
+    // N_thread==0: one thread less than the hardware threads (the main thread keeps rendering), at least 1
+    explicit thread_pool(unsigned int N_thread = 0);
+    ~thread_pool();
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+
+    void submit(std::function<void()> task);
+    size_t pending() const; // tasks submitted but not started yet
+    size_t size() const;    // number of worker threads
+
+private:
+    void run();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    bool stop = false;
+};
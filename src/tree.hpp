@@ -10,3 +10,7 @@ vcl::mesh create_tree_foliage();
 vcl::mesh create_champi();
 vcl::mesh create_street_lamp();
 vcl::mesh create_fontaine();
+
+// Revisions of the generators, added to the keys of their cached meshes: increment it at each change of the generator
+int const street_lamp_revision = 1;
+int const fontaine_revision = 1;